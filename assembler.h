@@ -13,7 +13,8 @@
     along with the generated object code, source line, and any errors
     associated with that source line.
     The object file contains the machine code translation of the assembly
-    source in hex.
+    source in hex. Modification records mark the address fields that
+    must change when the loader places the program at another address.
     Error checking is also done here.
 */
 
@@ -23,7 +24,13 @@
 #include <fstream>
 #include <sstream>
 #include <unordered_map>
+#include <unordered_set>
 #include <iomanip>
+#include <sys/stat.h>
+#include "util.h"
+#include "codec.h"
+#include "optimizer.h"
+#include "debuginfo.h"
 
 extern "C"{
     #include "sicengine.h"
@@ -33,12 +40,16 @@ using std::ifstream;
 using std::ofstream;
 using std::stringstream;
 using std::unordered_map;
+using std::unordered_set;
 
 class Assembler{
 
     private:
         //the location counter
         int locctr;
+
+        //address of the text record being filled by pass 2
+        int textRecordAddress;
         int startingAddress;
         int programLength;
 
@@ -55,25 +66,65 @@ class Assembler{
         const int sizePadding = 2;              //for byte size
         const int machineCodePadding = 60;      //for machine code section
         const int opcodePadding = 2;
+        const int addressFieldHalfBytes = 4;    //for modification records
 
         const int maxProgramSizeBytes = MSIZE;
 
         bool anyErrors;
 
+        //statistics
+        unsigned linesAssembled;
+        unsigned recordsWritten;
+
         //builds up a string of error codes for a
         //line in the asssembly source;
         string errors;
 
+        //set by createObjectCode when the object code holds a symbol
+        //address, which has to change if the program is relocated
+        bool relocatableAddress;
+
+        //addresses of the instructions with a relocatable address.
+        //They become modification records in the object file.
+        DynamicArray<int> modifications;
+
         //label and their address
         unordered_map<string, unsigned> symbolTable;
 
+        //for the debug information: the source, the line of each block of
+        //the intermediate file, and the statements of pass 2
+        string sourcePath;
+        DynamicArray<int> statementLines;
+        DynamicArray<DebugInfo::Statement> statements;
+
+        //the opcode and error tables, built once and shared by every
+        //assembler of the process
+        struct Tables{
+            unordered_map<string, unsigned> opcodeTable;
+            unordered_set<unsigned> formatOne;
+            unordered_map<string, string> errorCodes;
+
+            Tables(){
+                createOpTable(opcodeTable, formatOne);
+                createErrorCodes(errorCodes);
+            }
+        };
+
+        static const Tables& tables(){
+            static const Tables built;
+            return built;
+        }
+
         //Mneumonic and their opcode in hex
-        unordered_map<string, unsigned> opcodeTable;
+        const unordered_map<string, unsigned>& opcodeTable;
+
+        //opcodes of the 1 byte (format 1) instructions. They take no operand.
+        const unordered_set<unsigned>& formatOne;
 
         //errors
-        unordered_map<string, string> errorCodes;
+        const unordered_map<string, string>& errorCodes;
 
-        void createErrorCodes(){
+        static void createErrorCodes(unordered_map<string, string>& errorCodes){
             errorCodes.insert(std::make_pair("0001", "Invalid Operand"));
             errorCodes.insert(std::make_pair("0002", "Duplicate Symbol"));
             errorCodes.insert(std::make_pair("0003", "Invalid Opcode"));
@@ -97,11 +148,15 @@ class Assembler{
             errorCodes.insert(std::make_pair("0016","Illegal START Operand"));
 
             errorCodes.insert(std::make_pair("0017","Illegal END operand"));
+
+            //INCBIN
+            errorCodes.insert(std::make_pair("0018","INCBIN file cannot be read"));
+            errorCodes.insert(std::make_pair("0019","INCBIN offset or length outside the file"));
         }
 
-        void createOpTable(){
+        static void createOpTable(unordered_map<string, unsigned>& opcodeTable, unordered_set<unsigned>& formatOne){
             opcodeTable.insert(std::make_pair("ADD", 0x18));
-            opcodeTable.insert(std::make_pair("AND", 0x58));
+            opcodeTable.insert(std::make_pair("AND", 0x40));
             opcodeTable.insert(std::make_pair("COMP", 0x28));
             opcodeTable.insert(std::make_pair("DIV", 0x24));
             opcodeTable.insert(std::make_pair("J", 0x3C));
@@ -128,7 +183,53 @@ class Assembler{
             opcodeTable.insert(std::make_pair("SUB", 0x1C));
             opcodeTable.insert(std::make_pair("TD", 0xE0));
             opcodeTable.insert(std::make_pair("TIX", 0x2C));
+            opcodeTable.insert(std::make_pair("TS", 0x8C));
             opcodeTable.insert(std::make_pair("WD", 0xDC));
+
+            //SIC/XE i/o channels. SIO takes its channel program from register S.
+            opcodeTable.insert(std::make_pair("LDS", 0x6C));
+            opcodeTable.insert(std::make_pair("STS", 0x7C));
+            opcodeTable.insert(std::make_pair("LDT", 0x74));
+            opcodeTable.insert(std::make_pair("STT", 0x84));
+            opcodeTable.insert(std::make_pair("LDB", 0x68));
+            opcodeTable.insert(std::make_pair("STB", 0x78));
+            opcodeTable.insert(std::make_pair("SIO", 0xF0));
+            opcodeTable.insert(std::make_pair("HIO", 0xF4));
+            opcodeTable.insert(std::make_pair("TIO", 0xF8));
+            formatOne.insert(0xF0);
+            formatOne.insert(0xF4);
+            formatOne.insert(0xF8);
+
+            //SIC/XE floating point. Constants are written with BYTE X'...'
+            //in the 6 byte format (sign, 11 bit exponent, 36 bit fraction).
+            opcodeTable.insert(std::make_pair("ADDF", 0x58));
+            opcodeTable.insert(std::make_pair("SUBF", 0x5C));
+            opcodeTable.insert(std::make_pair("MULF", 0x60));
+            opcodeTable.insert(std::make_pair("DIVF", 0x64));
+            opcodeTable.insert(std::make_pair("LDF", 0x70));
+            opcodeTable.insert(std::make_pair("STF", 0x80));
+            opcodeTable.insert(std::make_pair("COMPF", 0x88));
+            opcodeTable.insert(std::make_pair("FLOAT", 0xC0));
+            opcodeTable.insert(std::make_pair("FIX", 0xC4));
+            opcodeTable.insert(std::make_pair("NORM", 0xC8));
+            formatOne.insert(0xC0);
+            formatOne.insert(0xC4);
+            formatOne.insert(0xC8);
+
+            //host services. The operand is the service number, 0 to 15.
+            opcodeTable.insert(std::make_pair("SVC", 0xB0));
+        }
+
+        //A X L B S T
+        static int registerNumber(const string& name){
+            const string names = "AXLBST";
+            size_t n = name.length() == 1 ? names.find(name[0]) : string::npos;
+            return n == string::npos ? 0 : n;
+        }
+
+        bool isFormatOne(const string& mnemonic){
+            unordered_map<string, unsigned>::const_iterator itr = opcodeTable.find(mnemonic);
+            return itr != opcodeTable.end() && formatOne.count(itr->second) != 0;
         }
 
         //For BYTE directive
@@ -197,14 +298,91 @@ class Assembler{
             return -1;
         }
 
+        //The label, opcode and operand of a line as written, without the
+        //upper case of getColumns. For the file names of INCBIN.
+        static void originalColumns(const string& srcLine, string& label, string& opcode, string& operand){
+            DynamicArray<string> parsedLine;
+            Util::parseLine(parsedLine, srcLine, "\t ");
+            if(!srcLine.empty() && (srcLine[0] == '\t' || srcLine[0] == ' '))
+                parsedLine.push_front("");
+            parsedLine.resize(3, "");
+            label = parsedLine.at(0);
+            opcode = parsedLine.at(1);
+            operand = parsedLine.at(2);
+        }
+
+        //Splits an INCBIN operand: "file"[,offset[,length]], decimal numbers.
+        //length is -1 if it is not given.
+        static bool parseIncluded(const string& operand, string& name, int& offset, int& length){
+            size_t quote = operand.find('"', 1);
+            if(operand.length() < 3 || operand[0] != '"' || quote == string::npos || quote == 1)
+                return false;
+            name = operand.substr(1, quote - 1);
+            offset = 0;
+            length = -1;
+
+            string rest = operand.substr(quote + 1);
+            if(rest.empty())
+                return true;
+            size_t comma = rest.find(',', 1);
+            if(rest[0] != ',' || !Codec::parseInt(rest.substr(1, comma == string::npos ? string::npos : comma - 1), offset, 10))
+                return false;
+            return comma == string::npos || Codec::parseInt(rest.substr(comma + 1), length, 10);
+        }
+
+        //A file named by INCBIN, next to the source unless the path is absolute
+        static string includedPath(const string& sourcePath, const string& name){
+            size_t slash = sourcePath.rfind('/');
+            if(name[0] == '/' || slash == string::npos)
+                return name;
+            return sourcePath.substr(0, slash + 1) + name;
+        }
+
+        //INCBIN "file"[,offset[,length]] takes the bytes of a binary file,
+        //all of it by default. Sets operand to what pass 2 reads (the path,
+        //offset and length) and returns the length.
+        int includedSize(const string& srcLine, string& operand){
+            string label, opcode, name;
+            int offset = 0, length = -1;
+            originalColumns(srcLine, label, opcode, operand);
+            if(!parseIncluded(operand, name, offset, length)){
+                errors += "0001";
+                return 0;
+            }
+
+            string path = includedPath(sourcePath, name);
+            struct stat info;
+            if(stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode)){
+                errors += "0018";
+                return 0;
+            }
+            off_t size = length < 0 ? info.st_size - offset : length;
+            if(offset < 0 || size < 0 || offset + size > info.st_size || size > maxProgramSizeBytes){
+                errors += "0019";
+                return 0;
+            }
+            operand = "\"" + path + "\"," + std::to_string(offset) + "," + std::to_string(size);
+            return size;
+        }
+
+        //Reads the bytes of an INCBIN operand written by includedSize
+        static bool readIncluded(const string& operand, string& bytes){
+            string path;
+            int offset = 0, length = 0;
+            if(!parseIncluded(operand, path, offset, length) || length < 0)
+                return false;
+            ifstream file(path, std::ios::binary);
+            bytes.assign(length, '\0');
+            return file.seekg(offset) && (length == 0 || file.read(&bytes[0], length));
+        }
+
         void getColumns(string& srcLine, const string& delims, string& label, string& opcode, string& operand){
             //convert to uppercase
             Util::toUpperCase(srcLine);
 
             DynamicArray<string> parsedLine;
             Util::parseLine(parsedLine, srcLine, delims);
-            parsedLine.pad("");
-            parsedLine.forceSize(4);
+            parsedLine.resize(4, "");
 
             //parsed line should now have the format:
             //  0      1      2      4
@@ -281,6 +459,79 @@ class Assembler{
             return true;
         }
 
+        //check for valid operand for instruction opcodes
+        //that do not have the following directives.
+        //Format 1 instructions have no operand.
+        void checkOperand(const string& opcode, const string& operand){
+            if(opcode != "BYTE" && opcode != "WORD" && opcode != "RESW" && opcode != "RESB"
+                    && opcode != "INCBIN" && opcode != "FILL" && opcode != "SVC" && !isFormatOne(opcode))
+                //not a valid symbol name or hex value
+                if(!isValidOperand(operand))
+                    errors += "0001";
+        }
+
+        //The number of bytes a statement takes (the increment for the location counter).
+        //opFound is set if opcode is an instruction rather than a directive.
+        int statementSize(const string& opcode, const string& operand, bool& opFound){
+            int increment = 0;
+            opFound = false;
+
+            if (opcode == "WORD"){
+                int tmp;
+                //If the operand for WORD is not a decimal number then
+                //it is an invalid operand.
+                if(!Codec::parseInt(operand, tmp, 10))
+                    errors += "0001";
+
+                //word takes 3 bytes
+                increment = 3;
+            }
+            else if (opcode == "RESW"){
+                int operandValue = -1;
+                if(Codec::parseInt(operand, operandValue, 10))
+                    increment = 3 * operandValue;
+
+                else errors += "0001";
+            }
+            else if (opcode == "RESB"){
+                int operandValue = -1;
+                if(Codec::parseInt(operand, operandValue, 10))
+                    increment = operandValue;
+
+                else errors += "0001";
+            }
+            else if (opcode == "FILL"){
+                int value = 0;
+                if(!parseFill(operand, increment, value)){
+                    increment = 0;
+                    errors += "0001";
+                }
+            }
+            else if (opcode == "BYTE"){
+                int length = getConstantLength(operand);
+                if(length != -1)
+                    increment = length;
+
+                else errors += "0001";
+            }
+            //opcode found - not a directive
+            else if( opcodeTable.find(opcode) != opcodeTable.end() ){
+                opFound = true;
+                increment = isFormatOne(opcode) ? 1 : 3;
+
+                //the service number of SVC is a decimal number
+                int service = -1;
+                if(opcode == "SVC"){
+                    if(!Codec::parseInt(operand, service, 10) || service < 0 || service > 15)
+                        errors += "0001";
+                    increment = 2;
+                }
+            }
+            //unknown opcode/unknown directive
+            else errors += "0003";
+            return increment;
+        }
+
         //For indexing.
         //SIC has a maximum memory of 32K bytes which requires 16 bits.
         //Address values will not exceed 16 bits so we can use
@@ -343,6 +594,29 @@ class Assembler{
                 return "";
 
             stringstream objectCodeStream("");
+            relocatableAddress = false;
+
+            //format 1 (the opcode is the whole instruction) and SVC n
+            //(format 2 with n in the first register field)
+            int code = -1;
+            if(Codec::parseInt(opcode, code, 16)){
+                if(formatOne.count(code) != 0)
+                    return Codec::hexValue(code, opcodePadding);
+
+                int service = 0;
+                if(code == (int)opcodeTable.at("SVC") && Codec::parseInt(operand, service, 10))
+                    return Codec::hexValue(code, opcodePadding) + Codec::hexValue(service, 1) + "0";
+
+                //TIXR r, written by the optimizer
+                if(code == 0xB8)
+                    return Codec::hexValue(code, opcodePadding) + Codec::hexValue(registerNumber(operand), 1) + "0";
+
+                //#value, written by the optimizer: SIC/XE format 3 with i set
+                //and the value (below 4096) as the displacement
+                int value = 0;
+                if(operand.length() > 1 && operand[0] == '#' && Codec::parseInt(operand.substr(1), value, 10))
+                    return Codec::hexValue(code | 1, opcodePadding) + Codec::hexValue(value, addressPadding);
+            }
 
             //For the BYTE operand (strings and hex numbers)
             stringstream byteDataStream("");
@@ -367,8 +641,9 @@ class Assembler{
 
                 //string - convert characters to ascii values for the object code
                 if(type == 'C'){
-                    for(char c : operandValue)
-                        byteDataStream << std::hex << (int)c;
+                    const unsigned char* chars =
+                        reinterpret_cast<const unsigned char*>(operandValue.data());
+                    byteDataStream << Codec::hexEncode(chars, operandValue.length());
                 }
 
                 //hex - give direct values to the object code
@@ -380,16 +655,15 @@ class Assembler{
             }
             else if(opcode == "WORD"){
                 //obtain a base 10 number
-                Util::stringToInt(operand, addressObjectCode, 10);
-                objectCodeStream << std::setw(basicPadding) << std::setfill('0');
-                objectCodeStream << std::hex << addressObjectCode;
+                Codec::parseInt(operand, addressObjectCode, 10);
+                objectCodeStream << Codec::hexValue(addressObjectCode, basicPadding);
             }
             //a hex address - must start with 0 (zero)
             //this value should be associated with an instruction
             else if(isHexSymbol(operand)){
 
                 //give direct values to the object code - convert from base 16 to 10
-                Util::stringToInt(operand, addressObjectCode, 16);
+                Codec::parseInt(operand, addressObjectCode, 16);
                 objectCodeStream << std::setw(opcodePadding) << std::setfill('0');
                 objectCodeStream << opcode;
                 objectCodeGenerated = true;
@@ -405,6 +679,11 @@ class Assembler{
                 if(isIndexed)
                     setMSB(addressObjectCode);
 
+                //the loader adds the relocation offset to the address field.
+                //It never carries into the index bit since relocated
+                //addresses stay below MSIZE.
+                relocatableAddress = true;
+
                 objectCodeStream << std::setw(opcodePadding) << std::setfill('0');
                 objectCodeStream << opcode;
                 objectCodeGenerated = true;
@@ -417,7 +696,7 @@ class Assembler{
                 int iOpcode = -1;
 
                 //rsub opcode is in base 16
-                if(Util::stringToInt(opcode, iOpcode, 16)){
+                if(Codec::parseInt(opcode, iOpcode, 16)){
 
                     //check if opcode matches to RSUB's
                     if(iOpcode == (int)rsubItr->second){
@@ -431,10 +710,8 @@ class Assembler{
             //Insert the address objectCode.
             if(objectCodeGenerated){
                 //Handle instructions
-                if(addressObjectCode != -1){
-                    objectCodeStream << std::setw(addressPadding) << std::setfill('0') << std::hex;
-                    objectCodeStream << addressObjectCode;
-                }
+                if(addressObjectCode != -1)
+                    objectCodeStream << Codec::hexValue(addressObjectCode, addressPadding);
                 //Handle BYTE directive - only contains data (string or hex number)
                 else objectCodeStream << byteDataStream.str();
             }
@@ -442,7 +719,7 @@ class Assembler{
         }
 
         //Each error code is of size "errorCodeSize" within the errorList string
-        bool reportErrors(ofstream& listingFile, const string& errorList){
+        bool reportErrors(std::ostream& listingFile, const string& errorList){
             unsigned len = errorList.length();
             if(len > 0){
                 unordered_map<string, string>::const_iterator itr;
@@ -472,48 +749,110 @@ class Assembler{
         }
 
         void createHeaderRecord(ofstream& objectfile, string progName, string address, int progLen){
+            recordsWritten++;
             objectfile << "H" << std::left << std::setw(basicPadding) << std::setfill(' ');
-            objectfile << progName;
-
-            objectfile << std::right << std::setw(basicPadding) << std::setfill('0');
+            objectfile << progName << std::right;
 
-            Util::toUpperCase(address);
-            objectfile << address;
+            int start = 0;
+            Codec::parseInt(address, start, 16);
+            objectfile << Codec::hexValue(start, basicPadding);
+            objectfile << Codec::hexValue(progLen, basicPadding) << endl;
+        }
 
-            objectfile << std::setw(basicPadding) << std::setfill('0');
-            objectfile << std::uppercase << std::hex;
-            objectfile << progLen << endl;
+        //One record per address field to relocate:
+        //M, field address (6), field length in half bytes (2).
+        //The address field is the last 4 half bytes of an instruction
+        //(including the index bit).
+        void createModificationRecords(ofstream& objectfile){
+            for(unsigned i = 0; i < modifications.size(); i++){
+                recordsWritten++;
+                objectfile << "M" << Codec::hexValue(modifications.at(i) + 1, basicPadding);
+                objectfile << Codec::hexValue(addressFieldHalfBytes, sizePadding) << endl;
+            }
         }
 
         void createEndRecord(ofstream& objectfile, int startingAddress){
-            objectfile << "E" << std::setw(basicPadding) << std::setfill('0');
-            objectfile << std::uppercase <<  std::hex;
-            objectfile << startingAddress;
+            recordsWritten++;
+            objectfile << "E" << Codec::hexValue(startingAddress, basicPadding);
         }
 
-        //Sets up the "T" and the address
-        void startTextRecord(ofstream& objectfile, string address){
-            objectfile << "T" << std::setw(basicPadding) << std::setfill('0');
-            Util::toUpperCase(address);
-            objectfile << address;
+        //Sets the address of the next text record. The record is written
+        //once it has its code, so that nothing else (a fill record) can
+        //land in the middle of it.
+        void startTextRecord(int address){
+            textRecordAddress = address;
+        }
+
+        void startTextRecord(const string& address){
+            int value = 0;
+            Codec::parseInt(address, value, 16);
+            startTextRecord(value);
         }
 
-        //Adds the size and the machine code/data to the text record
+        //Writes the text record: the "T", the address, the size and the machine code/data
         void finishTextRecord(ofstream& objectfile, int machineBufferSize,
                                 const stringstream& machineCodeStreamBuffer)
         {
-            objectfile << std::setw(sizePadding) << std::setfill('0');
-            objectfile << std::uppercase << std::hex;
+            recordsWritten++;
+            objectfile << "T" << Codec::hexValue(textRecordAddress, basicPadding);
 
             //convert to bytes
-            objectfile << machineBufferSize/2;
+            objectfile << Codec::hexValue(machineBufferSize/2, sizePadding);
 
             string code = machineCodeStreamBuffer.str();
             Util::toUpperCase(code);
             objectfile << code << endl;
         }
 
-        void writeToListingFile(ofstream& listingfile, string address, string objectCode,
+        //FILL count[,value]: count bytes (decimal) of value, a decimal byte, 0 by default
+        static bool parseFill(const string& operand, int& count, int& value){
+            size_t comma = operand.find(',');
+            value = 0;
+            if(!Codec::parseInt(operand.substr(0, comma), count, 10) || count < 0)
+                return false;
+            return comma == string::npos
+                || (Codec::parseInt(operand.substr(comma + 1), value, 10) && value >= 0 && value <= 255);
+        }
+
+        //F, address (6), count (6), value (2). The loader sets the bytes with memset.
+        void createFillRecord(ofstream& objectfile, int address, int count, int value){
+            recordsWritten++;
+            objectfile << "F" << Codec::hexValue(address, basicPadding) << Codec::hexValue(count, basicPadding);
+            objectfile << Codec::hexValue(value, sizePadding) << endl;
+        }
+
+        //Writes the bytes of INCBIN (as hex digits) into text records, after
+        //the object code already in the buffer of the current record. Each
+        //record is filled to the end and the last one stays open in the
+        //buffer for the statements that follow.
+        void writeIncludedData(ofstream& objectfile, stringstream& machineCodeStreamBuffer, int address,
+                                const string& hex, bool& makeNewTextRec)
+        {
+            if(hex.empty())
+                return;
+            if(makeNewTextRec){
+                startTextRecord(address);
+                makeNewTextRec = false;
+            }
+
+            machineCodeStreamBuffer.seekg(0, std::ios::end);
+            int machineBufferSize = machineCodeStreamBuffer.tellg();
+            for(size_t at = 0; at < hex.length(); ){
+                if(machineBufferSize == machineCodePadding){
+                    finishTextRecord(objectfile, machineBufferSize, machineCodeStreamBuffer);
+                    machineCodeStreamBuffer.clear();
+                    machineCodeStreamBuffer.str(std::string());
+                    machineBufferSize = 0;
+                    startTextRecord(address + at / 2);
+                }
+                size_t digits = std::min(hex.length() - at, (size_t)(machineCodePadding - machineBufferSize));
+                machineCodeStreamBuffer.write(hex.data() + at, digits);
+                machineBufferSize += digits;
+                at += digits;
+            }
+        }
+
+        void writeToListingFile(std::ostream& listingfile, string address, string objectCode,
                                     const string& sourceLine, const string& errorList)
         {
             Util::toUpperCase(address);
@@ -535,12 +874,15 @@ class Assembler{
         }
 
     public:
-        Assembler(){
-            createOpTable();
-            createErrorCodes();
+        Assembler() : opcodeTable(tables().opcodeTable), formatOne(tables().formatOne),
+                errorCodes(tables().errorCodes){
             programLength = 0;
             startingAddress = 0;
+            textRecordAddress = 0;
             anyErrors = false;
+            relocatableAddress = false;
+            linesAssembled = 0;
+            recordsWritten = 0;
         }
 
         void pass1(const string& src){
@@ -549,6 +891,7 @@ class Assembler{
 
             if(!source.is_open()){
                 cout << "Failed to load specified file\n";
+                anyErrors = true;
                 return;
             }
             //read entire file
@@ -561,7 +904,11 @@ class Assembler{
 
             bool startFound = false;
 
+            sourcePath = src;
+            int lineNumber = 0;
+            string originalLine;
             while(getline(source, srcLine)){
+                lineNumber++;
                 errors.clear();
                 //ignore empty lines
                 if(srcLine.empty()) continue;
@@ -570,11 +917,13 @@ class Assembler{
                 char firstChar = srcLine.at(0);
                 if(firstChar == '.') continue;
 
+                originalLine = srcLine;
                 getColumns(srcLine, delims, label, opcode, operand);
 
                 //empty columns
                 if(label.length() + opcode.length() + operand.length() == 0)
                     continue;
+                linesAssembled++;
 
                 /*Find the START directive*/
                 if(opcode == "START"){
@@ -591,7 +940,7 @@ class Assembler{
                             errors += "0004";
 
                     //set locctr to OPERAND of START if possible
-                    if(operand.empty() || !Util::stringToInt(operand, locctr, 16)){
+                    if(operand.empty() || !Codec::parseInt(operand, locctr, 16)){
                         //failed to give a proper value for locctr
                         locctr = startingAddress = 0;
                         errors += "0001";
@@ -600,6 +949,7 @@ class Assembler{
                         startingAddress = locctr;
                     }
                     intermediate << srcLine << endl;
+                    statementLines.push_back(lineNumber);
                     intermediate << opcode << endl;
                     intermediate << std::hex << locctr << endl;
                     intermediate << operand << endl;
@@ -613,16 +963,12 @@ class Assembler{
                     startFound = true;
                 }
 
-                //check for valid operand for instruction opcodes
-                //that do not have the following directives
-                if(opcode != "BYTE" && opcode != "WORD" && opcode != "RESW" && opcode != "RESB")
-                    //not a valid symbol name or hex value
-                    if(!isValidOperand(operand))
-                        errors += "0001";
+                checkOperand(opcode, operand);
 
                 if(opcode == "END"){
                     //write last line to intermediate file and save the program length
                     intermediate << srcLine << endl;
+                    statementLines.push_back(lineNumber);
                     intermediate << opcode << endl;
                     intermediate << std::hex << locctr << endl;
                     intermediate << operand << endl;
@@ -639,9 +985,6 @@ class Assembler{
                     //to flag that an opcode was found
                     bool opFound = false;
 
-                    //the increment for the location counter
-                    int increment = 0;
-
                     //if there is a label
                     if(!label.empty()){
                         //seach for label in symbol table
@@ -657,47 +1000,14 @@ class Assembler{
                         }
                     }
                     //search for opcode in optable
-                    if (opcode == "WORD"){
-                        int tmp;
-                        //If the operand for WORD is not a decimal number then
-                        //it is an invalid operand.
-                        if(!Util::stringToInt(operand, tmp, 10))
-                            errors += "0001";
-
-                        //word takes 3 bytes
-                        increment = 3;
-                    }
-                    else if (opcode == "RESW"){
-                        int operandValue = -1;
-                        if(Util::stringToInt(operand, operandValue, 10))
-                            increment = 3 * operandValue;
-
-                        else errors += "0001";
-                    }
-                    else if (opcode == "RESB"){
-                        int operandValue = -1;
-                        if(Util::stringToInt(operand, operandValue, 10))
-                            increment = operandValue;
-
-                        else errors += "0001";
-                    }
-                    else if (opcode == "BYTE"){
-                        int length = getConstantLength(operand);
-                        if(length != -1)
-                            increment = length;
-
-                        else errors += "0001";
-                    }
-                    //opcode found - not a directive
-                    else if( opcodeTable.find(opcode) != opcodeTable.end() ){
-                        opFound = true;
-                        increment = 3;
-                    }
-                    //unknown opcode/unknown directive
-                    else errors += "0003";
+                    int increment = 0;
+                    if(opcode == "INCBIN")
+                        increment = includedSize(originalLine, operand);
+                    else increment = statementSize(opcode, operand, opFound);
 
                     //write to intermediate file
                     intermediate << srcLine << endl;
+                    statementLines.push_back(lineNumber);
 
                     //convert opcodes to hex if they were found
                     if(opFound) intermediate << std::hex << opcodeTable.at(opcode) << endl;
@@ -731,6 +1041,7 @@ class Assembler{
 
             if(!intermediate.is_open()){
                 cout << "Failed to load the intermediate file!\n";
+                anyErrors = true;
                 return;
             }
             //Accumulates machine codes for a text record
@@ -739,6 +1050,8 @@ class Assembler{
             bool startSet = false;
             bool endFound = false;
             bool makeNewTextRec = false;
+            unsigned blocksRead = 0;
+            statements.clear();
 
             //read entire intermediate file
             while(true){
@@ -755,6 +1068,7 @@ class Assembler{
                 getline(intermediate, address);
                 getline(intermediate, operand);
                 getline(intermediate, errorList);
+                unsigned block = blocksRead++;
 
                 //no errors yet
                 if(!anyErrors)
@@ -777,7 +1091,7 @@ class Assembler{
                             else break;
                         }
                         createHeaderRecord(objectfile, programName, address, programLength);
-                        startTextRecord(objectfile, address);
+                        startTextRecord(address);
                     }
                     startSet = true;
                 }
@@ -788,12 +1102,18 @@ class Assembler{
 
                         //Create default header - NONAME, with loading address of zero
                         createHeaderRecord(objectfile, "NONAME", "00000", programLength);
-                        startTextRecord(objectfile, address);
+                        startTextRecord(address);
                     }
                     //calculate current size of machine code buffer
                     machineCodeStreamBuffer.seekg(0, std::ios::end);
                     int machineBufferSize = machineCodeStreamBuffer.tellg();
 
+                    //every statement ends where the next one (or END) starts
+                    int i_address = 0;
+                    Codec::parseInt(address, i_address, 16);
+                    if(!statements.empty())
+                        statements.at(statements.size() - 1).size = i_address - statements.at(statements.size() - 1).address;
+
                     if(opcode == "END"){
                         //save data into the object file if buffer isn't empty
                         if(machineBufferSize != 0)
@@ -802,6 +1122,8 @@ class Assembler{
 
                         writeToListingFile(listingfile, "", "", sourceLine, errorList);
 
+                        createModificationRecords(objectfile);
+
                         //create end record
                         createEndRecord(objectfile, startingAddress);
 
@@ -812,13 +1134,73 @@ class Assembler{
 
                     /*Some other instruction besides END or START*/
 
+                    DebugInfo::Statement statement;
+                    int code = 0;
+                    statement.address = i_address;
+                    statement.code = Codec::parseInt(opcode, code, 16);
+                    statement.line = block < statementLines.size() ? statementLines.at(block) : 0;
+                    statement.source = sourceLine;
+                    statements.push_back(statement);
+
+                    //the bytes of a binary file go straight into the text
+                    //records, the listing only shows the first ones
+                    if(opcode == "INCBIN"){
+                        string bytes, objectCode = "------";
+                        if(errorList.empty() && !readIncluded(operand, bytes)){
+                            errorList = "0018";
+                            anyErrors = true;
+                        }
+                        if(errorList.empty()){
+                            const unsigned char* data = reinterpret_cast<const unsigned char*>(bytes.data());
+                            objectCode = Codec::hexEncode(data, std::min(bytes.length(), (size_t)4));
+                            if(bytes.length() > 4)
+                                objectCode += "...";
+                            writeIncludedData(objectfile, machineCodeStreamBuffer, i_address,
+                                Codec::hexEncode(data, bytes.length()), makeNewTextRec);
+                        }
+                        if(errorList.empty())
+                            sourceLine += "\t(" + std::to_string(bytes.length()) + " bytes)";
+                        writeToListingFile(listingfile, address, objectCode, sourceLine, errorList);
+                        continue;
+                    }
+
+                    //a region of one byte value is a fill record between the
+                    //text records, instead of its bytes
+                    if(opcode == "FILL"){
+                        int count = 0, value = 0;
+                        string objectCode = "------";
+                        if(errorList.empty() && parseFill(operand, count, value)){
+                            if(machineBufferSize != 0){
+                                finishTextRecord(objectfile, machineBufferSize, machineCodeStreamBuffer);
+                                machineCodeStreamBuffer.clear();
+                                machineCodeStreamBuffer.str(std::string());
+                            }
+                            makeNewTextRec = true;
+                            if(count > 0)
+                                createFillRecord(objectfile, i_address, count, value);
+
+                            objectCode = "";
+                            for(int n = 0; n < count && n < 4; n++)
+                                objectCode += Codec::hexValue(value, sizePadding);
+                            if(count > 4)
+                                objectCode += "...";
+                            sourceLine += "\t(" + std::to_string(count) + " bytes)";
+                        }
+                        writeToListingFile(listingfile, address, objectCode, sourceLine, errorList);
+                        continue;
+                    }
+
                     string objectCode = "------";
 
                     //Produce object code if there are no errors
-                    if(errorList.empty())
+                    if(errorList.empty()){
                         //create object code for instruction
                         objectCode = createObjectCode(opcode, operand);
 
+                        if(relocatableAddress)
+                            modifications.push_back(i_address);
+                    }
+
                     writeToListingFile(listingfile, address, objectCode, sourceLine, errorList);
 
                     //calculate the number of characters in the machine code section
@@ -828,7 +1210,7 @@ class Assembler{
                     //That way, we add the correct address of the next instruction that is not
                     //a reserve.
                     if(!objectCode.empty() && makeNewTextRec){
-                        startTextRecord(objectfile, address);
+                        startTextRecord(address);
                         makeNewTextRec = false;
                     }
                     //Object code does not fit in text record OR if a RESW or RESB was
@@ -843,7 +1225,7 @@ class Assembler{
 
                             //start new record containing the address of a non-reserve instruction
                             if(!objectCode.empty())
-                                startTextRecord(objectfile, address);
+                                startTextRecord(address);
 
                             //reserve directive detected, don't save its address for the text record
                             else makeNewTextRec = true;
@@ -852,6 +1234,9 @@ class Assembler{
                             machineCodeStreamBuffer.clear();
                             machineCodeStreamBuffer.str(std::string());
                         }
+                        //a reserve before any code: the record starts after it
+                        else if(objectCode.empty())
+                            makeNewTextRec = true;
                     }
                     //Add object code machineCodesBuffer but if the objectCode is empty
                     //then do not write anything to the buffer since that signifies
@@ -881,8 +1266,157 @@ class Assembler{
             objectfile.close();
 
             //delete object file if there are any errors
-            if(anyErrors)
+            if(anyErrors){
                 remove("object.txt");
+                remove("object.dbg");
+            }
+            else writeDebugInfo();
+        }
+
+        //Writes object.dbg, the debug information for object.txt (see debuginfo.h)
+        bool writeDebugInfo(){
+            return DebugInfo::write("object.dbg", sourcePath, statements, symbolTable);
+        }
+
+        //The optional pass between pass1 and pass2 (see optimizer.h)
+        Optimizer::Report optimize(){
+            Optimizer optimizer;
+            if(anyErrors){
+                Optimizer::Report report;
+                report.reason = "the source has errors";
+                return report;
+            }
+            return optimizer.run("intermediate.txt", opcodeTable, symbolTable, programLength, statementLines);
+        }
+
+        //A block of the intermediate file
+        struct Block{
+            string source;
+            string opcode;
+            string address;
+            string operand;
+            string errors;
+        };
+
+        //For watch mode (see watch.h). Reassembles srcLine in place of the
+        //line of block, after pass 2, when that can be done without pass 1:
+        //the line keeps its label and size, both lines are free of errors and
+        //the relocation (modification record) of the address does not change.
+        //Sets the block, the object code and the listing line for srcLine.
+        //Returns false if the program has to be assembled again.
+        bool reassembleLine(string srcLine, Block& block, string& objectCode, string& listingLine){
+            if(!block.errors.empty() || block.opcode == "START" || block.opcode == "END")
+                return false;
+            if(srcLine.empty() || srcLine.at(0) == '.')
+                return false;
+
+            string delims = "\t ";
+            string label, opcode, operand;
+            string oldLabel, oldOpcode, oldOperand;
+            string oldSource = block.source;
+            getColumns(srcLine, delims, label, opcode, operand);
+            getColumns(oldSource, delims, oldLabel, oldOpcode, oldOperand);
+            if(label.length() + opcode.length() + operand.length() == 0 || label != oldLabel)
+                return false;
+            if(opcode == "START" || opcode == "END")
+                return false;
+
+            //reserved space ends a text record, so it has to stay where it is.
+            //A fill has a record of its own.
+            bool reserve = opcode == "RESW" || opcode == "RESB";
+            bool oldReserve = oldOpcode == "RESW" || oldOpcode == "RESB";
+            if(reserve != oldReserve || opcode == "FILL" || oldOpcode == "FILL")
+                return false;
+
+            bool opFound = false;
+            errors.clear();
+            int oldSize = statementSize(oldOpcode, oldOperand, opFound);
+            errors.clear();
+            checkOperand(opcode, operand);
+            int size = statementSize(opcode, operand, opFound);
+            if(!errors.empty() || size != oldSize)
+                return false;
+
+            string code = opcode;
+            if(opFound){
+                stringstream hex;
+                hex << std::hex << opcodeTable.at(opcode);
+                code = hex.str();
+            }
+
+            int address = 0;
+            Codec::parseInt(block.address, address, 16);
+            bool relocated = false;
+            for(unsigned i = 0; i < modifications.size() && !relocated; i++)
+                relocated = modifications.at(i) == address;
+
+            string operandField = operand;
+            objectCode = createObjectCode(code, operandField);
+            if(relocatableAddress != relocated || (!reserve && objectCode.length() != (unsigned)size * 2))
+                return false;
+            Util::toUpperCase(objectCode);
+
+            stringstream listing;
+            writeToListingFile(listing, block.address, objectCode, srcLine, "");
+            listingLine = listing.str();
+            listingLine.pop_back();     //the end of line
+
+            //the statement of the debug information
+            for(unsigned i = 0; i < statements.size(); i++)
+                if(statements.at(i).address == address && statements.at(i).source == block.source){
+                    statements.at(i).source = srcLine;
+                    statements.at(i).code = opFound;
+                    break;
+                }
+
+            block.source = srcLine;
+            block.opcode = code;
+            block.operand = operand;
+            return true;
+        }
+
+        //The files a source includes with INCBIN, each path followed by its
+        //bytes. They are part of the key of the assembly cache.
+        static string includedFiles(const string& sourcePath, const string& source){
+            string files;
+            std::istringstream lines(source);
+            string line, label, opcode, operand, name;
+            while(getline(lines, line)){
+                if(line.empty() || line[0] == '.')
+                    continue;
+                originalColumns(line, label, opcode, operand);
+                Util::toUpperCase(opcode);
+                int offset = 0, length = 0;
+                if(opcode != "INCBIN" || !parseIncluded(operand, name, offset, length))
+                    continue;
+
+                string path = includedPath(sourcePath, name);
+                ifstream file(path, std::ios::binary);
+                files += path;
+                files.push_back('\0');
+                files.append(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+                files.push_back('\0');
+            }
+            return files;
+        }
+
+        //true if the source had errors and no object file was produced
+        bool hasErrors() const{
+            return anyErrors;
+        }
+
+        //source lines that held an instruction or directive
+        unsigned getLinesAssembled() const{
+            return linesAssembled;
+        }
+
+        unsigned getSymbolCount() const{
+            return symbolTable.size();
+        }
+
+        //records written to the object file
+        unsigned getRecordsWritten() const{
+            return recordsWritten;
         }
 
         void displaySymbolTable(){
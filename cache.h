@@ -0,0 +1,234 @@
+
+/*
+    A persistent, content-addressed cache of assembled programs.
+
+    The key of an assembly is a hash of the source bytes and the
+    assembler options. An entry holds what the assembler produced for
+    it: the object, listing, intermediate and debug files, the counts that go
+    into the statistics and any report it printed. When the same source is assembled again
+    with the same options, the files are written back from the entry
+    instead of running the passes.
+
+    Each entry is one file <key>.entry in the cache directory:
+        SICASM-CACHE <version> <source length>
+        <lines assembled> <symbols> <records written>
+        <name> <length>        then length bytes, for each file
+        report <length>        then the report
+    Entries are written to a temporary file and renamed, so a reader
+    never sees half an entry. The directory is kept under a size cap by
+    removing the least recently used entries (a hit touches its entry).
+*/
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <cstdio>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <functional>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "dynamic_array.h"
+#include "util.h"
+
+using std::ifstream;
+using std::ofstream;
+
+class AssemblyCache{
+
+    public:
+        //what an assembly produced besides its files
+        struct Result{
+            unsigned lines;
+            unsigned symbols;
+            unsigned records;
+            string report;      //printed by the assembler, e.g. the optimizer report
+
+            Result() : lines(0), symbols(0), records(0){}
+        };
+
+    private:
+        //changes whenever the assembler output for a source can change
+        static const int version = 3;
+
+        //files kept in an entry, as the assembler writes them
+        static const char* const* files(){
+            static const char* const names[] = {"object.txt", "listing.txt", "intermediate.txt", "object.dbg", NULL};
+            return names;
+        }
+
+        string directory;
+        off_t capacity;        //bytes
+
+        static uint64_t fnv(uint64_t hash, const string& bytes){
+            for(size_t i = 0; i < bytes.length(); i++){
+                hash ^= static_cast<unsigned char>(bytes[i]);
+                hash *= 1099511628211ULL;
+            }
+            return hash;
+        }
+
+        string path(const string& key) const{
+            return directory + "/" + key + ".entry";
+        }
+
+    public:
+        AssemblyCache(const string& directory = ".sicasm-cache", off_t capacity = 8 << 20) :
+            directory(directory), capacity(capacity){}
+
+        //A name next to path for an entry being written. Processes and
+        //the threads of the daemon can store the same key at once, so
+        //the name holds both the pid and the thread.
+        static string temporary(const string& path){
+            size_t thread = std::hash<std::thread::id>()(std::this_thread::get_id());
+            return path + "." + std::to_string(getpid()) + "." + std::to_string(thread);
+        }
+
+        //Removes the least recently used entries of directory until it
+        //fits in capacity bytes. The runs kept by RunCache (runcache.h)
+        //share the directory and count towards it.
+        static void evict(const string& directory, off_t capacity){
+            DIR* dir = opendir(directory.c_str());
+            if(dir == NULL)
+                return;
+
+            struct Entry{
+                string path;
+                off_t size;
+                struct timespec used;
+            };
+            DynamicArray<Entry> entries;
+            off_t total = 0;
+            for(struct dirent* e = readdir(dir); e != NULL; e = readdir(dir)){
+                string name = e->d_name;
+                bool assembly = name.length() > 6 && name.compare(name.length() - 6, 6, ".entry") == 0;
+                bool run = name.length() > 4 && name.compare(name.length() - 4, 4, ".run") == 0;
+                if(!assembly && !run)
+                    continue;
+                Entry entry;
+                entry.path = directory + "/" + name;
+                struct stat info;
+                if(stat(entry.path.c_str(), &info) != 0)
+                    continue;
+                entry.size = info.st_size;
+                entry.used = info.st_mtim;
+                total += entry.size;
+                entries.push_back(entry);
+            }
+            closedir(dir);
+
+            while(total > capacity && !entries.empty()){
+                unsigned oldest = 0;
+                for(unsigned i = 1; i < entries.size(); i++){
+                    const struct timespec& a = entries.at(i).used;
+                    const struct timespec& b = entries.at(oldest).used;
+                    if(a.tv_sec < b.tv_sec || (a.tv_sec == b.tv_sec && a.tv_nsec < b.tv_nsec))
+                        oldest = i;
+                }
+                remove(entries.at(oldest).path.c_str());
+                total -= entries.at(oldest).size;
+                entries.at(oldest) = entries.at(entries.size() - 1);
+                entries.resize(entries.size() - 1, Entry());
+            }
+        }
+
+        //Reads a whole file into bytes. False if it cannot be read.
+        static bool readFile(const string& path, string& bytes){
+            ifstream file(path, std::ios::binary | std::ios::ate);
+            if(!file.is_open())
+                return false;
+            std::streamoff size = file.tellg();
+            file.seekg(0);
+            bytes.assign(size, '\0');
+            return size == 0 || file.read(&bytes[0], size);
+        }
+
+        //The key of source assembled with options, as 16 hex digits
+        static string key(const string& source, const string& options){
+            uint64_t hash = 14695981039346656037ULL;
+            hash = fnv(hash, std::to_string(version) + '\0' + options + '\0');
+            hash = fnv(hash, source);
+            char text[17];
+            snprintf(text, sizeof text, "%016llx", static_cast<unsigned long long>(hash));
+            return text;
+        }
+
+        //Writes the files of the entry for key back and sets result.
+        //sourceLength guards against a hash collision. False on a miss.
+        bool fetch(const string& key, size_t sourceLength, Result& result){
+            string entryPath = path(key);
+            ifstream entry(entryPath, std::ios::binary);
+            if(!entry.is_open())
+                return false;
+
+            string magic;
+            int entryVersion = 0;
+            size_t length = 0;
+            entry >> magic >> entryVersion >> length;
+            entry >> result.lines >> result.symbols >> result.records;
+            if(!entry || magic != "SICASM-CACHE" || entryVersion != version || length != sourceLength)
+                return false;
+
+            //read every file before writing any, so that a damaged
+            //entry leaves the previous output alone
+            DynamicArray<string> contents;
+            for(const char* const* name = files(); *name != NULL; name++){
+                string stored;
+                size_t size = 0;
+                entry >> stored >> size;
+                entry.get();
+                string bytes(size, '\0');
+                if(!entry || stored != *name || !entry.read(&bytes[0], size))
+                    return false;
+                contents.push_back(bytes);
+            }
+            string stored;
+            size_t size = 0;
+            entry >> stored >> size;
+            entry.get();
+            result.report.assign(size, '\0');
+            if(!entry || stored != "report" || (size > 0 && !entry.read(&result.report[0], size)))
+                return false;
+
+            unsigned i = 0;
+            for(const char* const* name = files(); *name != NULL; name++, i++){
+                ofstream out(*name, std::ios::binary);
+                out << contents.at(i);
+            }
+
+            utimes(entryPath.c_str(), NULL);      //most recently used
+            return true;
+        }
+
+        //Saves the files the assembler just wrote under key
+        void store(const string& key, size_t sourceLength, const Result& result){
+            mkdir(directory.c_str(), 0777);
+
+            string temporary = AssemblyCache::temporary(path(key));
+            {
+                ofstream entry(temporary, std::ios::binary);
+                if(!entry.is_open())
+                    return;
+                entry << "SICASM-CACHE " << version << " " << sourceLength << "\n";
+                entry << result.lines << " " << result.symbols << " " << result.records << "\n";
+                for(const char* const* name = files(); *name != NULL; name++){
+                    string bytes;
+                    if(!readFile(*name, bytes)){
+                        entry.close();
+                        remove(temporary.c_str());
+                        return;
+                    }
+                    entry << *name << " " << bytes.length() << "\n" << bytes;
+                }
+                entry << "report " << result.report.length() << "\n" << result.report;
+            }
+            rename(temporary.c_str(), path(key).c_str());
+            evict(directory, capacity);
+        }
+};
+
+#endif
@@ -0,0 +1,281 @@
+
+/*
+    Hex codec and number parsing.
+
+    Converts between hex text and bytes for the loader, the assembler
+    and the memory dump. Decoding and encoding are table driven, with
+    SSE2 and AVX2 paths for long runs of bytes when the compiler targets
+    them (-msse2 is the default on x86-64, -mavx2 enables the wider path).
+
+    parseInt replaces the old Util::stringToInt. It uses table lookups
+    instead of pow() and rejects values that do not fit in an int.
+*/
+
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <string>
+#include <climits>
+#include <cstddef>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+using std::string;
+
+class Codec{
+
+    private:
+        //Lookup tables, built once (thread safe) on first use
+        struct Tables{
+            //value of each character as a digit, -1 if it is not a digit.
+            //Letters count as digits 10 to 35 for both cases.
+            signed char digit[256];
+
+            //two upper case hex digits for every byte value
+            char hex[512];
+
+            Tables(){
+                const char* digits = "0123456789ABCDEF";
+                for(int c = 0; c < 256; c++){
+                    if(c >= '0' && c <= '9')        digit[c] = c - '0';
+                    else if(c >= 'A' && c <= 'Z')   digit[c] = c - 'A' + 10;
+                    else if(c >= 'a' && c <= 'z')   digit[c] = c - 'a' + 10;
+                    else                            digit[c] = -1;
+
+                    hex[2*c]   = digits[c >> 4];
+                    hex[2*c+1] = digits[c & 0xF];
+                }
+            }
+        };
+
+        static const Tables& tables(){
+            static const Tables instance;
+            return instance;
+        }
+
+        static const signed char* digitTable(){
+            return tables().digit;
+        }
+
+        static const char* byteTable(){
+            return tables().hex;
+        }
+
+#if defined(__SSE2__)
+        //Converts 16 hex characters to their nibble values.
+        //Returns false if any of them is not a hex digit.
+        static bool nibbles(__m128i chars, __m128i& values){
+            __m128i lower = _mm_or_si128(chars, _mm_set1_epi8(0x20));
+
+            __m128i isDigit = _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('0' - 1)),
+                                            _mm_cmplt_epi8(chars, _mm_set1_epi8('9' + 1)));
+            __m128i isLetter = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                             _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+
+            if(_mm_movemask_epi8(_mm_or_si128(isDigit, isLetter)) != 0xFFFF)
+                return false;
+
+            __m128i digit = _mm_sub_epi8(chars, _mm_set1_epi8('0'));
+            __m128i letter = _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10));
+            values = _mm_or_si128(_mm_and_si128(isDigit, digit), _mm_andnot_si128(isDigit, letter));
+            return true;
+        }
+
+        //Decodes 16 hex characters into 8 bytes
+        static bool decode16(const char* src, unsigned char* dst){
+            __m128i values;
+            if(!nibbles(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)), values))
+                return false;
+
+            //each 16 bit lane holds the high nibble in its low byte
+            //and the low nibble in its high byte
+            __m128i high = _mm_slli_epi16(_mm_and_si128(values, _mm_set1_epi16(0x00FF)), 4);
+            __m128i low = _mm_srli_epi16(values, 8);
+            __m128i bytes = _mm_packus_epi16(_mm_or_si128(high, low), _mm_setzero_si128());
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dst), bytes);
+            return true;
+        }
+
+        //nibble values to upper case hex characters
+        static __m128i toHex(__m128i values){
+            __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(values, _mm_set1_epi8(9)), _mm_set1_epi8('A' - '0' - 10));
+            return _mm_add_epi8(_mm_add_epi8(values, _mm_set1_epi8('0')), letters);
+        }
+
+        //Encodes 8 bytes into 16 hex characters
+        static void encode8(const unsigned char* src, char* dst){
+            __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src));
+            __m128i mask = _mm_set1_epi8(0x0F);
+            __m128i high = _mm_and_si128(_mm_srli_epi16(bytes, 4), mask);
+            __m128i low = _mm_and_si128(bytes, mask);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), toHex(_mm_unpacklo_epi8(high, low)));
+        }
+#endif
+
+#if defined(__AVX2__)
+        //Decodes 32 hex characters into 16 bytes
+        static bool decode32(const char* src, unsigned char* dst){
+            __m256i chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+            __m256i lower = _mm256_or_si256(chars, _mm256_set1_epi8(0x20));
+
+            __m256i isDigit = _mm256_and_si256(_mm256_cmpgt_epi8(chars, _mm256_set1_epi8('0' - 1)),
+                                               _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), chars));
+            __m256i isLetter = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+                                                _mm256_cmpgt_epi8(_mm256_set1_epi8('f' + 1), lower));
+
+            if(_mm256_movemask_epi8(_mm256_or_si256(isDigit, isLetter)) != -1)
+                return false;
+
+            __m256i digit = _mm256_sub_epi8(chars, _mm256_set1_epi8('0'));
+            __m256i letter = _mm256_sub_epi8(lower, _mm256_set1_epi8('a' - 10));
+            __m256i values = _mm256_blendv_epi8(letter, digit, isDigit);
+
+            __m256i high = _mm256_slli_epi16(_mm256_and_si256(values, _mm256_set1_epi16(0x00FF)), 4);
+            __m256i low = _mm256_srli_epi16(values, 8);
+
+            //packing works per 128 bit half, gather the two results together
+            __m256i bytes = _mm256_packus_epi16(_mm256_or_si256(high, low), _mm256_setzero_si256());
+            bytes = _mm256_permute4x64_epi64(bytes, 0x08);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm256_castsi256_si128(bytes));
+            return true;
+        }
+
+        //Encodes 16 bytes into 32 hex characters
+        static void encode16(const unsigned char* src, char* dst){
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+            __m128i mask = _mm_set1_epi8(0x0F);
+            __m128i high = _mm_and_si128(_mm_srli_epi16(bytes, 4), mask);
+            __m128i low = _mm_and_si128(bytes, mask);
+
+            __m256i values = _mm256_set_m128i(_mm_unpackhi_epi8(high, low), _mm_unpacklo_epi8(high, low));
+            __m256i letters = _mm256_and_si256(_mm256_cmpgt_epi8(values, _mm256_set1_epi8(9)),
+                                               _mm256_set1_epi8('A' - '0' - 10));
+            __m256i chars = _mm256_add_epi8(_mm256_add_epi8(values, _mm256_set1_epi8('0')), letters);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), chars);
+        }
+#endif
+
+    public:
+        //Converts src to an integer of the specified base (2 to 16).
+        //Fails on an empty string, on invalid digits and if the
+        //value does not fit in an int.
+        static bool parseInt(const char* src, size_t len, int& dst, int base){
+            //nothing to process is an error
+            if(len == 0)
+                return false;
+
+            const signed char* table = digitTable();
+            int limit = INT_MAX / base;
+            int sum = 0;
+            for(size_t i = 0; i < len; i++){
+                int digit = table[(unsigned char)src[i]];
+                if(digit < 0 || digit >= base)
+                    return false;
+
+                //sum * base + digit would overflow
+                if(sum > limit || sum * base > INT_MAX - digit)
+                    return false;
+                sum = sum * base + digit;
+            }
+            dst = sum;
+            return true;
+        }
+
+        static bool parseInt(const string& src, int& dst, int base){
+            return parseInt(src.data(), src.length(), dst, base);
+        }
+
+        //Decodes len hex characters (len must be even) into len/2 bytes.
+        //Returns false if a character is not a hex digit; dst is then
+        //only partially written.
+        static bool hexDecode(const char* src, size_t len, unsigned char* dst){
+            if(len % 2 != 0)
+                return false;
+
+            size_t i = 0;
+#if defined(__AVX2__)
+            for(; i + 32 <= len; i += 32)
+                if(!decode32(src + i, dst + i/2))
+                    return false;
+#endif
+#if defined(__SSE2__)
+            for(; i + 16 <= len; i += 16)
+                if(!decode16(src + i, dst + i/2))
+                    return false;
+#endif
+            const signed char* table = digitTable();
+            for(; i < len; i += 2){
+                int high = table[(unsigned char)src[i]];
+                int low = table[(unsigned char)src[i+1]];
+                if(high < 0 || high > 15 || low < 0 || low > 15)
+                    return false;
+                dst[i/2] = (unsigned char)(high << 4 | low);
+            }
+            return true;
+        }
+
+        static bool hexDecode(const string& src, unsigned char* dst){
+            return hexDecode(src.data(), src.length(), dst);
+        }
+
+        //Encodes len bytes into 2*len upper case hex characters (no terminator)
+        static void hexEncode(const unsigned char* src, size_t len, char* dst){
+            size_t i = 0;
+#if defined(__AVX2__)
+            for(; i + 16 <= len; i += 16)
+                encode16(src + i, dst + 2*i);
+#endif
+#if defined(__SSE2__)
+            for(; i + 8 <= len; i += 8)
+                encode8(src + i, dst + 2*i);
+#endif
+            const char* table = byteTable();
+            for(; i < len; i++){
+                dst[2*i]   = table[2*src[i]];
+                dst[2*i+1] = table[2*src[i]+1];
+            }
+        }
+
+        static string hexEncode(const unsigned char* src, size_t len){
+            string hex(2*len, '0');
+            hexEncode(src, len, &hex[0]);
+            return hex;
+        }
+
+        //Writes the two upper case hex digits of b
+        static void hexByte(unsigned char b, char* dst){
+            const char* table = byteTable();
+            dst[0] = table[2*b];
+            dst[1] = table[2*b+1];
+        }
+
+        //Writes value as exactly digits upper case hex digits, zero padded.
+        //Higher digits that do not fit are dropped.
+        static void hexValue(unsigned long value, int digits, char* dst){
+            const char* table = byteTable();
+            for(int i = digits-1; i >= 0; i--){
+                dst[i] = table[2*(value & 0xF)+1];
+                value >>= 4;
+            }
+        }
+
+        //Same as above, but at least digits wide (like setw/setfill('0'))
+        static string hexValue(unsigned long value, int digits){
+            int needed = 1;
+            for(unsigned long v = value >> 4; v != 0; v >>= 4)
+                needed++;
+            if(needed < digits)
+                needed = digits;
+
+            string hex(needed, '0');
+            hexValue(value, needed, &hex[0]);
+            return hex;
+        }
+};
+
+#endif
@@ -19,6 +19,10 @@ class Command{
         string name;
         unsigned parameters;
 
+        //commands with optional parameters accept
+        //between parameters and maxParameters parameters
+        unsigned maxParameters;
+
         //tolerance for string subset
         //This can be used to differentiate
         //which subsets belong to their super set.
@@ -28,28 +32,38 @@ class Command{
         unsigned nameTolerance;
 
         //function pointer to the execution to be
-        //done by the command
-        void(*execution)(const array&);
+        //done by the command.
+        //The execution returns true if it succeeded.
+        bool(*execution)(const array&);
 
     public:
-        Command(): name(""), parameters(0), nameTolerance(0){}
-        Command(string name) : name(name), parameters(0), nameTolerance(1) {}
-        Command(const string& name, unsigned parameters, unsigned nameTol, void(*exe)(const array&)) :
-                        name(name), parameters(parameters), nameTolerance(nameTol), execution(exe){}
+        Command(): name(""), parameters(0), maxParameters(0), nameTolerance(0){}
+        Command(string name) : name(name), parameters(0), maxParameters(0), nameTolerance(1) {}
+        Command(const string& name, unsigned parameters, unsigned nameTol, bool(*exe)(const array&)) :
+                        name(name), parameters(parameters), maxParameters(parameters),
+                        nameTolerance(nameTol), execution(exe){}
+        Command(const string& name, unsigned minParams, unsigned maxParams, unsigned nameTol, bool(*exe)(const array&)) :
+                        name(name), parameters(minParams), maxParameters(maxParams),
+                        nameTolerance(nameTol), execution(exe){}
 
         //Assumption: Command name has been matched in the interpreter
         //Takes in an array "line" that contains the parsed line,
         //chopped up into its proper components.
         //This function will then process that array and run the
         //specified execution on that array.
-        void process(const array& line) const{
+        //Returns false if the parameters were wrong or the execution failed.
+        bool process(const array& line) const{
             if(!line.empty()){
                 //check for number of parameters
-                if(line.size()-1 == this->parameters)
-                    (*execution)(line);
-                else
+                unsigned given = line.size()-1;
+                if(given >= this->parameters && given <= this->maxParameters)
+                    return (*execution)(line);
+                else if(parameters == maxParameters)
                     cout << "Error. " << name << " takes " << parameters << " parameter(s).";
+                else
+                    cout << "Error. " << name << " takes " << parameters << " to " << maxParameters << " parameter(s).";
             }
+            return false;
         }
 
         bool operator==(const Command& c) const{
@@ -0,0 +1,21 @@
+
+/*
+    The stream that everything prints to.
+
+    Every thread has its own cout, with its own formatting state (hex,
+    width, precision), so a run on a worker thread never changes the
+    format of what another thread prints. It writes to the standard
+    output unless its thread sends it elsewhere with rdbuf(), as the
+    daemon does while a thread serves a client (see daemon.h).
+*/
+
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include <iostream>
+
+inline thread_local std::ostream cout(std::cout.rdbuf());
+
+using std::endl;
+
+#endif
@@ -0,0 +1,270 @@
+
+/*
+    The resident assembler and simulator: "sicasm --daemon socket".
+
+    One process keeps the engine, the assembler tables and the command
+    interpreter ready and serves clients over a Unix domain socket, so
+    a request costs no process start. Each connection is served by a
+    thread of a pool and has its own machine sessions for as long as it
+    stays connected (see main.cpp). What the commands print goes back
+    to the client instead of the standard output.
+
+    The protocol is a stream of frames, a 4 byte length (network order)
+    followed by that many bytes:
+        request     'k' to keep going after a failing command or '-' to
+                    stop at the first one, then the commands, separated
+                    by ';' or newlines
+        reply       the exit status of the commands ('0' or '1'), then
+                    what they printed
+    A client sends a request and reads its reply, as many times as it
+    likes on the same connection. "sicasm --connect socket" is one.
+*/
+
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "dynamic_array.h"
+#include "util.h"
+
+class Daemon{
+
+    public:
+        //called on the thread serving a connection
+        struct Handlers{
+            std::function<void()> connected;
+            std::function<int(const string& commands, bool keepGoing)> request;
+            std::function<void()> disconnected;
+            //called once on the thread of run when the daemon stops,
+            //before it waits for the requests being served
+            std::function<void()> stopping;
+        };
+
+    private:
+        //the largest frame accepted, requests are command lines
+        static const uint32_t maxFrame = 1 << 20;
+
+        string path;
+        unsigned threads;
+        Handlers handlers;
+
+        std::atomic<bool> stopped;
+
+        //accepted connections waiting for a thread of the pool
+        std::deque<int> waiting;
+        std::mutex lock;
+        std::condition_variable arrived;
+
+        //Waits until file can be read or the daemon is stopped
+        bool readable(int file){
+            struct pollfd ready = {file, POLLIN, 0};
+            while(!stopped.load()){
+                int events = poll(&ready, 1, 200);
+                if(events > 0)
+                    return true;
+                if(events < 0 && errno != EINTR)
+                    return false;
+            }
+            return false;
+        }
+
+        static bool readAll(int file, char* bytes, size_t length){
+            while(length > 0){
+                ssize_t n = read(file, bytes, length);
+                if(n < 0 && errno == EINTR)
+                    continue;
+                if(n <= 0)
+                    return false;
+                bytes += n;
+                length -= n;
+            }
+            return true;
+        }
+
+        static bool writeAll(int file, const char* bytes, size_t length){
+            while(length > 0){
+                ssize_t n = send(file, bytes, length, MSG_NOSIGNAL);
+                if(n < 0 && errno == EINTR)
+                    continue;
+                if(n <= 0)
+                    return false;
+                bytes += n;
+                length -= n;
+            }
+            return true;
+        }
+
+        //Serves the requests of a connection until the client closes it
+        void serve(int client){
+            handlers.connected();
+
+            std::stringbuf output;
+            std::streambuf* console = cout.rdbuf();
+            string request;
+            while(readable(client) && readFrame(client, request) && !request.empty()){
+                output.str("");
+                cout.rdbuf(&output);
+                int status = handlers.request(request.substr(1), request[0] == 'k');
+                cout.flush();
+                cout.rdbuf(console);
+
+                string reply = output.str();
+                reply.insert(reply.begin(), status == 0 ? '0' : '1');
+                if(!writeFrame(client, reply))
+                    break;
+            }
+
+            handlers.disconnected();
+            close(client);
+        }
+
+        void work(){
+            while(true){
+                int client = -1;
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    arrived.wait(guard, [this]{ return stopped.load() || !waiting.empty(); });
+                    if(waiting.empty())
+                        return;
+                    client = waiting.front();
+                    waiting.pop_front();
+                }
+                serve(client);
+            }
+        }
+
+    public:
+        Daemon(const string& path, unsigned threads, const Handlers& handlers) :
+            path(path), threads(threads), handlers(handlers), stopped(false){}
+
+        //Reads a frame. False at the end of the stream or on a bad frame.
+        static bool readFrame(int file, string& bytes){
+            uint32_t length = 0;
+            if(!readAll(file, reinterpret_cast<char*>(&length), sizeof length))
+                return false;
+            length = ntohl(length);
+            if(length > maxFrame)
+                return false;
+            bytes.assign(length, '\0');
+            return length == 0 || readAll(file, &bytes[0], length);
+        }
+
+        static bool writeFrame(int file, const string& bytes){
+            uint32_t length = htonl(bytes.length());
+            return writeAll(file, reinterpret_cast<const char*>(&length), sizeof length)
+                && writeAll(file, bytes.data(), bytes.length());
+        }
+
+        //Connects to the daemon listening at path. -1 if there is none.
+        static int connectTo(const string& path){
+            struct sockaddr_un address;
+            if(path.length() >= sizeof address.sun_path)
+                return -1;
+            memset(&address, 0, sizeof address);
+            address.sun_family = AF_UNIX;
+            memcpy(address.sun_path, path.c_str(), path.length());
+
+            int file = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if(file >= 0 && connect(file, reinterpret_cast<struct sockaddr*>(&address), sizeof address) != 0){
+                close(file);
+                file = -1;
+            }
+            return file;
+        }
+
+        //Sends commands on a connection and waits for what they printed.
+        //Returns their exit status (0 or 1), -1 if the connection failed.
+        static int call(int file, const string& commands, bool keepGoing, string& output){
+            string reply;
+            if(!writeFrame(file, (keepGoing ? "k" : "-") + commands) || !readFrame(file, reply) || reply.empty())
+                return -1;
+            output = reply.substr(1);
+            return reply[0] == '0' ? 0 : 1;
+        }
+
+        //Listens at path and serves clients until stop.
+        //False if the socket cannot be created.
+        bool run(){
+            struct sockaddr_un address;
+            if(path.length() >= sizeof address.sun_path){
+                cout << "Error. The socket path is too long.\n";
+                return false;
+            }
+            memset(&address, 0, sizeof address);
+            address.sun_family = AF_UNIX;
+            memcpy(address.sun_path, path.c_str(), path.length());
+
+            //a socket left behind by a daemon that is gone
+            struct stat info;
+            if(stat(path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)){
+                int other = connectTo(path);
+                if(other >= 0){
+                    close(other);
+                    cout << "Error. A daemon is already listening at " << path << ".\n";
+                    return false;
+                }
+                unlink(path.c_str());
+            }
+
+            int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if(listener < 0 || bind(listener, reinterpret_cast<struct sockaddr*>(&address), sizeof address) != 0
+                    || listen(listener, 64) != 0){
+                cout << "Error. Cannot listen at " << path << ".\n";
+                if(listener >= 0)
+                    close(listener);
+                return false;
+            }
+
+            DynamicArray<std::thread> pool;
+            for(unsigned i = 0; i < threads; i++)
+                pool.emplace_back(&Daemon::work, this);
+            cout << "Listening at " << path << " with " << threads << " threads (Ctrl-C stops).\n";
+            cout.flush();
+
+            while(readable(listener)){
+                int client = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+                if(client < 0)
+                    continue;
+                std::lock_guard<std::mutex> guard(lock);
+                waiting.push_back(client);
+                arrived.notify_one();
+            }
+
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                stopped.store(true);
+                arrived.notify_all();
+            }
+            if(handlers.stopping)
+                handlers.stopping();
+            for(unsigned i = 0; i < pool.size(); i++)
+                pool.at(i).join();
+            for(unsigned i = 0; i < waiting.size(); i++)
+                close(waiting.at(i));
+            close(listener);
+            unlink(path.c_str());
+            return true;
+        }
+
+        //Ends run once the requests being served are done, which the
+        //stopping handler can hurry. Safe to call from a signal handler.
+        void stop(){
+            stopped.store(true);
+        }
+};
+
+#endif
@@ -0,0 +1,312 @@
+
+/*
+    Debug information: what connects the addresses of a program to its
+    source, written by pass 2 of the assembler next to the object file
+    (object.txt -> object.dbg) and read by the "where" and "status"
+    commands.
+
+    The file is binary, a header followed by tables of 32 bit words in
+    host order and a table of NUL terminated strings:
+        header      "SICD", version, then the number of entries of each table
+        ranges      start, end, line, source text   sorted by address
+        lines       line, address                    sorted by line
+        symbols     address, name                    sorted by address
+        names       index into symbols               sorted by name
+        regions     start, end, code (1) or data (0) sorted by address
+        strings     the source path first
+    A loaded file is used in place, once every string offset and name
+    index in it is checked. Lookups by address, line or name are
+    binary searches.
+*/
+
+#ifndef DEBUGINFO_H
+#define DEBUGINFO_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+#include <algorithm>
+#include "dynamic_array.h"
+#include "util.h"
+
+using std::unordered_map;
+
+class DebugInfo{
+
+    public:
+        //a statement of the source, as pass 2 saw it
+        struct Statement{
+            int address;
+            int size;           //bytes
+            int line;           //in the source file, from 1
+            bool code;          //an instruction rather than data
+            string source;
+
+            Statement() : address(0), size(0), line(0), code(false){}
+        };
+
+    private:
+        static const uint32_t version = 1;
+
+        struct Header{
+            char magic[4];
+            uint32_t version;
+            uint32_t ranges;
+            uint32_t lines;
+            uint32_t symbols;
+            uint32_t regions;
+            uint32_t strings;       //bytes
+        };
+
+        struct Range{
+            uint32_t start;
+            uint32_t end;
+            uint32_t line;
+            uint32_t source;
+        };
+
+        struct Line{
+            uint32_t line;
+            uint32_t address;
+        };
+
+        struct Symbol{
+            uint32_t address;
+            uint32_t name;
+        };
+
+        struct Region{
+            uint32_t start;
+            uint32_t end;
+            uint32_t code;
+        };
+
+        //the whole file, the tables point into it
+        string data;
+        const Header* header;
+        const Range* ranges;
+        const Line* lines;
+        const Symbol* symbols;
+        const uint32_t* names;
+        const Region* regions;
+        const char* strings;
+
+        template <typename T>
+        static void put(string& out, const T& value){
+            out.append(reinterpret_cast<const char*>(&value), sizeof value);
+        }
+
+        //index of the last entry of table (of count) whose key is <= key, -1 if none
+        template <typename T, typename Key>
+        static long below(const T* table, uint32_t count, uint32_t key, Key keyOf){
+            long low = 0, high = count;
+            while(low < high){
+                long middle = (low + high) / 2;
+                if(keyOf(table[middle]) <= key)
+                    low = middle + 1;
+                else
+                    high = middle;
+            }
+            return low - 1;
+        }
+
+        DebugInfo(const DebugInfo&);
+        DebugInfo& operator=(const DebugInfo&);
+
+    public:
+        DebugInfo() : header(NULL), ranges(NULL), lines(NULL), symbols(NULL),
+            names(NULL), regions(NULL), strings(NULL){}
+
+        //the debug file of an object file
+        static string pathFor(const string& objectPath){
+            size_t dot = objectPath.rfind('.');
+            size_t slash = objectPath.rfind('/');
+            if(dot == string::npos || (slash != string::npos && dot < slash))
+                return objectPath + ".dbg";
+            return objectPath.substr(0, dot) + ".dbg";
+        }
+
+        //Writes the debug file for statements, in address order, and symbols.
+        static bool write(const string& path, const string& sourcePath,
+                const DynamicArray<Statement>& statements, const unordered_map<string, unsigned>& symbolTable){
+            string text;
+            text.append(sourcePath).push_back('\0');
+
+            DynamicArray<Range> rangeTable;
+            DynamicArray<Line> lineTable;
+            DynamicArray<Region> regionTable;
+            for(unsigned i = 0; i < statements.size(); i++){
+                const Statement& s = statements.at(i);
+                if(s.size <= 0)
+                    continue;
+                Range range = {(uint32_t)s.address, (uint32_t)(s.address + s.size), (uint32_t)s.line, (uint32_t)text.length()};
+                text.append(s.source).push_back('\0');
+                rangeTable.push_back(range);
+
+                Line line = {(uint32_t)s.line, (uint32_t)s.address};
+                lineTable.push_back(line);
+
+                //neighbouring statements of the same kind make one region
+                if(!regionTable.empty()){
+                    Region& last = regionTable.at(regionTable.size() - 1);
+                    if(last.end == range.start && last.code == (uint32_t)s.code){
+                        last.end = range.end;
+                        continue;
+                    }
+                }
+                Region region = {range.start, range.end, (uint32_t)s.code};
+                regionTable.push_back(region);
+            }
+            if(!rangeTable.empty())
+                std::stable_sort(&lineTable.at(0), &lineTable.at(0) + lineTable.size(),
+                    [](const Line& a, const Line& b){ return a.line < b.line; });
+
+            DynamicArray<Symbol> symbolTableOut;
+            DynamicArray<string> symbolNames;
+            for(unordered_map<string, unsigned>::const_iterator itr = symbolTable.begin(); itr != symbolTable.end(); itr++){
+                Symbol symbol = {itr->second, (uint32_t)text.length()};
+                text.append(itr->first).push_back('\0');
+                symbolTableOut.push_back(symbol);
+            }
+            DynamicArray<uint32_t> nameIndex;
+            if(!symbolTableOut.empty()){
+                const char* names = text.data();
+                std::sort(&symbolTableOut.at(0), &symbolTableOut.at(0) + symbolTableOut.size(),
+                    [names](const Symbol& a, const Symbol& b){
+                        return a.address != b.address ? a.address < b.address : strcmp(names + a.name, names + b.name) < 0;
+                    });
+                for(uint32_t i = 0; i < symbolTableOut.size(); i++)
+                    nameIndex.push_back(i);
+                const DynamicArray<Symbol>& table = symbolTableOut;
+                std::sort(&nameIndex.at(0), &nameIndex.at(0) + nameIndex.size(),
+                    [&table, names](uint32_t a, uint32_t b){
+                        return strcmp(names + table.at(a).name, names + table.at(b).name) < 0;
+                    });
+            }
+
+            Header h;
+            memcpy(h.magic, "SICD", 4);
+            h.version = version;
+            h.ranges = rangeTable.size();
+            h.lines = lineTable.size();
+            h.symbols = symbolTableOut.size();
+            h.regions = regionTable.size();
+            h.strings = text.length();
+
+            string out;
+            put(out, h);
+            for(unsigned i = 0; i < rangeTable.size(); i++)     put(out, rangeTable.at(i));
+            for(unsigned i = 0; i < lineTable.size(); i++)      put(out, lineTable.at(i));
+            for(unsigned i = 0; i < symbolTableOut.size(); i++) put(out, symbolTableOut.at(i));
+            for(unsigned i = 0; i < nameIndex.size(); i++)      put(out, nameIndex.at(i));
+            for(unsigned i = 0; i < regionTable.size(); i++)    put(out, regionTable.at(i));
+            out += text;
+
+            std::ofstream file(path, std::ios::binary);
+            return file.is_open() && file.write(out.data(), out.length());
+        }
+
+        //Loads a debug file. False if it is missing or not valid.
+        bool open(const string& path){
+            std::ifstream file(path, std::ios::binary | std::ios::ate);
+            if(!file.is_open())
+                return false;
+            std::streamoff size = file.tellg();
+            file.seekg(0);
+            data.assign(size, '\0');
+            if(size < (std::streamoff)sizeof(Header) || !file.read(&data[0], size))
+                return false;
+
+            header = reinterpret_cast<const Header*>(data.data());
+            if(memcmp(header->magic, "SICD", 4) != 0 || header->version != version)
+                return false;
+            uint64_t expected = sizeof(Header) + (uint64_t)header->ranges * sizeof(Range)
+                + (uint64_t)header->lines * sizeof(Line) + (uint64_t)header->symbols * (sizeof(Symbol) + sizeof(uint32_t))
+                + (uint64_t)header->regions * sizeof(Region) + header->strings;
+            if(expected != (uint64_t)size || header->strings == 0 || data[size - 1] != '\0')
+                return false;
+
+            const char* at = data.data() + sizeof(Header);
+            ranges = reinterpret_cast<const Range*>(at);
+            at += header->ranges * sizeof(Range);
+            lines = reinterpret_cast<const Line*>(at);
+            at += header->lines * sizeof(Line);
+            symbols = reinterpret_cast<const Symbol*>(at);
+            at += header->symbols * sizeof(Symbol);
+            names = reinterpret_cast<const uint32_t*>(at);
+            at += header->symbols * sizeof(uint32_t);
+            regions = reinterpret_cast<const Region*>(at);
+            at += header->regions * sizeof(Region);
+            strings = at;
+
+            //the lookups follow these without checking, a stale or
+            //damaged file must not send them out of the data
+            bool valid = true;
+            for(uint32_t i = 0; i < header->ranges && valid; i++)
+                valid = ranges[i].source < header->strings;
+            for(uint32_t i = 0; i < header->symbols && valid; i++)
+                valid = symbols[i].name < header->strings && names[i] < header->symbols;
+            if(!valid)
+                header = NULL;
+            return valid;
+        }
+
+        const char* sourcePath() const{
+            return strings;
+        }
+
+        //The source line and text of the statement at address
+        bool lineAt(int address, int& line, string& source) const{
+            long i = below(ranges, header->ranges, address, [](const Range& r){ return r.start; });
+            if(i < 0 || (uint32_t)address >= ranges[i].end)
+                return false;
+            line = ranges[i].line;
+            source = strings + ranges[i].source;
+            return true;
+        }
+
+        //The first address of a source line
+        bool addressOfLine(int line, int& address) const{
+            long i = below(lines, header->lines, line, [](const Line& l){ return l.line; });
+            if(i < 0 || lines[i].line != (uint32_t)line)
+                return false;
+            while(i > 0 && lines[i - 1].line == (uint32_t)line)
+                i--;
+            address = lines[i].address;
+            return true;
+        }
+
+        //The nearest symbol at or before address, and how far address is past it
+        bool symbolAt(int address, string& name, int& offset) const{
+            long i = below(symbols, header->symbols, address, [](const Symbol& s){ return s.address; });
+            if(i < 0)
+                return false;
+            //the first of several symbols at the same address
+            while(i > 0 && symbols[i - 1].address == symbols[i].address)
+                i--;
+            name = strings + symbols[i].name;
+            offset = address - symbols[i].address;
+            return true;
+        }
+
+        bool addressOf(const string& name, int& address) const{
+            const uint32_t* end = names + header->symbols;
+            const uint32_t* i = std::lower_bound(names, end, name,
+                [this](uint32_t index, const string& key){ return key.compare(strings + symbols[index].name) > 0; });
+            if(i == end || name != strings + symbols[*i].name)
+                return false;
+            address = symbols[*i].address;
+            return true;
+        }
+
+        //1 if address holds code, 0 data, -1 if it is outside the program
+        int kindAt(int address) const{
+            long i = below(regions, header->regions, address, [](const Region& r){ return r.start; });
+            if(i < 0 || (uint32_t)address >= regions[i].end)
+                return -1;
+            return regions[i].code;
+        }
+};
+
+#endif
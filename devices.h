@@ -0,0 +1,253 @@
+
+/*
+    Device backends.
+
+    By default the input devices F1-F3 and the output devices 04-06 of
+    a machine read and write the files named in SICFile (devf1, dev05 ...).
+    A backend attached with SICAttach replaces the file of one device:
+        FileDevice       any file
+        BufferDevice     bytes in memory (input text, or captured output)
+        GeneratorDevice  bytes produced by a function
+        RingDevice       a lock-free single producer, single consumer ring
+                         that connects the output device of one machine
+                         to the input device of another one
+
+    Backends exchange SIC bytes. Like the device files, text is converted
+    so that the end of a line is the byte 0 (end of record).
+*/
+
+#ifndef DEVICES_H
+#define DEVICES_H
+
+#include <cstdio>
+#include <atomic>
+#include <functional>
+#include "util.h"
+
+extern "C"{
+    #include "sicengine.h"
+}
+
+class Device{
+
+    private:
+        SICDEVICE device;
+
+        static Device* self(SICDEVICE* d){
+            return static_cast<Device*>(d->Data);
+        }
+
+        static BOOLEAN readyHook(SICDEVICE* d, BOOLEAN output){
+            return self(d)->ready(output) ? TRUE : FALSE;
+        }
+
+        static int readHook(SICDEVICE* d){
+            return self(d)->read();
+        }
+
+        static void writeHook(SICDEVICE* d, BYTE b){
+            self(d)->write(b);
+        }
+
+        static void endHook(SICDEVICE* d){
+            self(d)->end();
+        }
+
+        //the engine keeps a pointer to device
+        Device(const Device&);
+        Device& operator=(const Device&);
+
+    public:
+        Device(){
+            device.Ready = &readyHook;
+            device.Read = &readHook;
+            device.Write = &writeHook;
+            device.End = &endHook;
+            device.Data = this;
+        }
+
+        virtual ~Device(){}
+
+        //what SICAttach takes
+        SICDEVICE* handle(){
+            return &device;
+        }
+
+        //true if a byte can be read (or written when output is true) now
+        virtual bool ready(bool output){
+            return true;
+        }
+
+        //next byte, -1 at the end of the data
+        virtual int read(){
+            return -1;
+        }
+
+        virtual void write(BYTE b){}
+
+        //the machine writing to the device has stopped
+        virtual void end(){}
+
+        //one line description for "device list"
+        virtual string describe() const = 0;
+
+        //text character to SIC byte and back
+        static BYTE fromText(char c){
+            return c == '\n' ? 0 : static_cast<BYTE>(c);
+        }
+
+        static char toText(BYTE b){
+            return b == 0 ? '\n' : static_cast<char>(b);
+        }
+};
+
+class FileDevice : public Device{
+
+    private:
+        string path;
+        FILE* file;
+        bool output;
+
+    public:
+        FileDevice(const string& path, bool output) :
+            path(path), file(fopen(path.c_str(), output ? "w" : "r")), output(output){}
+
+        ~FileDevice(){
+            if(file != NULL)
+                fclose(file);
+        }
+
+        bool isOpen() const{
+            return file != NULL;
+        }
+
+        int read(){
+            int c = file == NULL ? EOF : fgetc(file);
+            return c == EOF ? -1 : fromText(static_cast<char>(c));
+        }
+
+        void write(BYTE b){
+            if(file != NULL)
+                fputc(toText(b), file);
+        }
+
+        //output is flushed once the program is done with it
+        void end(){
+            if(file != NULL)
+                fflush(file);
+        }
+
+        string describe() const{
+            return string("file ") + path;
+        }
+};
+
+class BufferDevice : public Device{
+
+    private:
+        string data;
+        size_t position;
+
+    public:
+        BufferDevice(const string& text = "") : position(0){
+            data.reserve(text.length());
+            for(size_t i = 0; i < text.length(); i++)
+                data.push_back(static_cast<char>(fromText(text[i])));
+        }
+
+        int read(){
+            if(position >= data.length())
+                return -1;
+            return static_cast<BYTE>(data[position++]);
+        }
+
+        void write(BYTE b){
+            data.push_back(static_cast<char>(b));
+        }
+
+        //the bytes as text
+        string text() const{
+            string out(data.length(), ' ');
+            for(size_t i = 0; i < data.length(); i++)
+                out[i] = toText(static_cast<BYTE>(data[i]));
+            return out;
+        }
+
+        string describe() const{
+            return "buffer (" + std::to_string(data.length()) + " bytes)";
+        }
+};
+
+class GeneratorDevice : public Device{
+
+    private:
+        //returns the next byte, -1 when there are no more
+        std::function<int()> generate;
+        string description;
+
+    public:
+        GeneratorDevice(const std::function<int()>& generate, const string& description) :
+            generate(generate), description(description){}
+
+        int read(){
+            return generate();
+        }
+
+        string describe() const{
+            return "generator " + description;
+        }
+};
+
+class RingDevice : public Device{
+
+    private:
+        static const size_t capacity = 4096;       //a power of 2
+
+        BYTE buffer[capacity];
+
+        //head is only advanced by the reader and tail by the writer,
+        //so neither needs a lock
+        alignas(64) std::atomic<size_t> head;
+        alignas(64) std::atomic<size_t> tail;
+        std::atomic<bool> closed;
+
+        string description;
+
+    public:
+        RingDevice(const string& description) :
+            head(0), tail(0), closed(false), description(description){}
+
+        //a reader is also ready at the end, so that RD can report it
+        bool ready(bool output){
+            size_t used = tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+            if(output)
+                return used < capacity;
+            return used > 0 || closed.load(std::memory_order_acquire);
+        }
+
+        int read(){
+            size_t h = head.load(std::memory_order_relaxed);
+            if(h == tail.load(std::memory_order_acquire))
+                return -1;
+            BYTE b = buffer[h & (capacity - 1)];
+            head.store(h + 1, std::memory_order_release);
+            return b;
+        }
+
+        //the writer only writes after TD found room
+        void write(BYTE b){
+            size_t t = tail.load(std::memory_order_relaxed);
+            buffer[t & (capacity - 1)] = b;
+            tail.store(t + 1, std::memory_order_release);
+        }
+
+        void end(){
+            closed.store(true, std::memory_order_release);
+        }
+
+        string describe() const{
+            return "pipe " + description;
+        }
+};
+
+#endif
@@ -2,9 +2,9 @@
 #ifndef DYNAMIC_ARRAY_H
 #define DYNAMIC_ARRAY_H
 
-#include <iostream>
-using std::cout;
-using std::endl;
+#include <new>
+#include <utility>
+#include "console.h"
 
 /*
     A wrapper class that handles dynamic allocation
@@ -12,12 +12,19 @@ using std::endl;
 
     This container keeps the elements in no particular order.
 
+    Storage:
+        The first InlineCapacity elements live inside the object itself,
+        so small arrays (such as the tokens of a parsed line) never
+        allocate. Elements are only constructed when they are added,
+        and they are moved (not copied) when the storage grows.
+
     Resizing:
-        Doubles array size if we reached a size >= capacity
-        Halves array size if we reached a size <= capacity and size > minCapacity
+        Doubles array size if we need more than the capacity
+        Halves array size if we reached a size <= capacity/4 and the
+        storage is on the heap
 */
 
-template <typename T>
+template <typename T, unsigned InlineCapacity = 8>
 class DynamicArray{
 
     private:
@@ -26,112 +33,231 @@ class DynamicArray{
         //the capacity of the container before
         //there is a need for memory re-allocation
         unsigned capacity;
-        const unsigned minCapacity = 16;
 
-        //array container to hold our elements
+        //array container to hold our elements.
+        //Points to the inline buffer or to heap storage.
         T* container;
 
-        //resizes by either expanding or shrinking
-        //the array container
-        void resize(unsigned newSize){
-            //have a pointer to old container
+        //raw storage for the first InlineCapacity elements
+        alignas(T) unsigned char buffer[InlineCapacity * sizeof(T)];
+
+        T* inlineStorage(){
+            return reinterpret_cast<T*>(buffer);
+        }
+
+        bool onHeap() const{
+            return container != reinterpret_cast<const T*>(buffer);
+        }
+
+        //moves the elements into raw storage of the new capacity
+        void reallocate(unsigned newCapacity){
+            if(newCapacity < numberOfElements)
+                return;
+
             T* old = container;
+            bool oldOnHeap = onHeap();
+
+            if(newCapacity <= InlineCapacity){
+                newCapacity = InlineCapacity;
+                container = inlineStorage();
+            }
+            else container = static_cast<T*>(::operator new(newCapacity * sizeof(T)));
 
-            //create new container and update new capacity
-            container = new T[newSize];
-            capacity = newSize;
+            //nothing to do if the storage did not change
+            if(container == old)
+                return;
+            capacity = newCapacity;
 
             //fill in the new container
-            for(int i = 0; i < numberOfElements; i++)
-                container[i] = old[i];
+            for(unsigned i = 0; i < numberOfElements; i++){
+                new (&container[i]) T(std::move(old[i]));
+                old[i].~T();
+            }
 
             //free old memory
-            delete[] old;
+            if(oldOnHeap)
+                ::operator delete(old);
+        }
+
+        //makes room for one more element
+        void grow(){
+            if(numberOfElements == capacity)
+                reallocate(capacity * 2);
+        }
+
+        void destroyAll(){
+            for(unsigned i = 0; i < numberOfElements; i++)
+                container[i].~T();
+            numberOfElements = 0;
         }
 
         void swap(T& a, T& b){
-            T& temp(a);
-            a = b;
-            b = temp;
+            T temp(std::move(a));
+            a = std::move(b);
+            b = std::move(temp);
         }
 
     public:
         //construct container
         DynamicArray() :
-            numberOfElements(0)
+            numberOfElements(0), capacity(InlineCapacity), container(inlineStorage()){}
+
+        DynamicArray(unsigned capacity):
+            numberOfElements(0), capacity(InlineCapacity), container(inlineStorage())
+        {
+            reserve(capacity);
+        }
+
+        DynamicArray(const DynamicArray& other):
+            numberOfElements(0), capacity(InlineCapacity), container(inlineStorage())
         {
-            capacity = minCapacity;
-            container = new T[capacity];
+            reserve(other.numberOfElements);
+            for(unsigned i = 0; i < other.numberOfElements; i++)
+                push_back(other.container[i]);
         }
 
-        DynamicArray(int capacity):
-            numberOfElements(0), capacity(capacity)
+        //steals the heap storage, or moves the inline elements one by one
+        DynamicArray(DynamicArray&& other):
+            numberOfElements(0), capacity(InlineCapacity), container(inlineStorage())
         {
-            container = new T[capacity];
+            if(other.onHeap()){
+                container = other.container;
+                capacity = other.capacity;
+                numberOfElements = other.numberOfElements;
+
+                other.container = other.inlineStorage();
+                other.capacity = InlineCapacity;
+                other.numberOfElements = 0;
+            }
+            else{
+                for(unsigned i = 0; i < other.numberOfElements; i++)
+                    push_back(std::move(other.container[i]));
+                other.clear();
+            }
+        }
+
+        DynamicArray& operator=(const DynamicArray& other){
+            if(this != &other){
+                DynamicArray copy(other);
+                *this = std::move(copy);
+            }
+            return *this;
+        }
+
+        DynamicArray& operator=(DynamicArray&& other){
+            if(this != &other){
+                destroyAll();
+                if(onHeap())
+                    ::operator delete(container);
+                container = inlineStorage();
+                capacity = InlineCapacity;
+
+                if(other.onHeap()){
+                    container = other.container;
+                    capacity = other.capacity;
+                    numberOfElements = other.numberOfElements;
+
+                    other.container = other.inlineStorage();
+                    other.capacity = InlineCapacity;
+                    other.numberOfElements = 0;
+                }
+                else{
+                    for(unsigned i = 0; i < other.numberOfElements; i++)
+                        push_back(std::move(other.container[i]));
+                    other.clear();
+                }
+            }
+            return *this;
         }
 
         //free all memory
         ~DynamicArray(){
-            delete[] container;
+            destroyAll();
+            if(onHeap())
+                ::operator delete(container);
         }
 
-        void push_front(const T& entry){
+        //makes sure that capacity elements fit without reallocating
+        void reserve(unsigned newCapacity){
+            if(newCapacity > capacity)
+                reallocate(newCapacity);
+        }
+
+        void push_front(T entry){
+            grow();
+
             //shift everyone one position forward
-            for(int i = numberOfElements-1; i >= 0; i--)
-                container[i+1] = container[i];
+            if(numberOfElements > 0){
+                new (&container[numberOfElements]) T(std::move(container[numberOfElements-1]));
+                for(unsigned i = numberOfElements-1; i > 0; i--)
+                    container[i] = std::move(container[i-1]);
+                container[0] = std::move(entry);
+            }
+            else new (&container[0]) T(std::move(entry));
 
-            //set new value
-            container[0] = entry;
             numberOfElements++;
-
-            if(numberOfElements == capacity)
-                resize(capacity * 2);
         }
 
         void push_back(const T& entry){
-            //insert at the end
-            container[numberOfElements++] = entry;
+            //the entry may live in this container
+            if(numberOfElements == capacity){
+                T copy(entry);
+                emplace_back(std::move(copy));
+            }
+            else emplace_back(entry);
+        }
 
-            //resize if we hit the cap
-            if(numberOfElements == capacity)
-                resize(capacity * 2);
+        void push_back(T&& entry){
+            emplace_back(std::move(entry));
+        }
+
+        //constructs the new element in place at the end
+        template <typename... Args>
+        T& emplace_back(Args&&... args){
+            grow();
+            T* entry = new (&container[numberOfElements]) T(std::forward<Args>(args)...);
+            numberOfElements++;
+            return *entry;
         }
 
         void remove(const T& target){
             //find the target
-            int i;
-            for(i = 0; i < numberOfElements; i++){
+            for(unsigned i = 0; i < numberOfElements; i++){
                 //found
                 if(container[i] == target){
                     //swap with last element to simulate a removal
-                    swap(container[i], container[numberOfElements-1]);
+                    if(i != numberOfElements-1)
+                        swap(container[i], container[numberOfElements-1]);
+                    container[numberOfElements-1].~T();
                     numberOfElements--;
 
                     //shrink if there is too much spaced unsused
-                    if(numberOfElements > minCapacity && numberOfElements <= capacity/4)
-                        resize(capacity/2);
+                    if(onHeap() && numberOfElements <= capacity/4)
+                        reallocate(capacity/2);
                     break;
                 }
             }
         }
 
-        //pads the remaining slots in the container to the specified param
-        void pad(const T& entry){
-            for(int i = numberOfElements; i < capacity-1; i++)
-                container[i] = entry;
-        }
+        //Sets the number of elements to size.
+        //New elements are copies of entry, extra elements are destroyed.
+        void resize(unsigned size, const T& entry){
+            while(numberOfElements > size)
+                container[--numberOfElements].~T();
 
-        //Sets the numberOfElements to the specified param.
-        //Param must be smaller than capacity and >= 0
-        void forceSize(unsigned size){
-            if(size >= 0 && size < capacity)
-                numberOfElements = size;
+            reserve(size);
+            while(numberOfElements < size)
+                emplace_back(entry);
         }
 
         const T& at(unsigned index) const{
             return container[index];
         }
 
+        T& at(unsigned index){
+            return container[index];
+        }
+
         unsigned size() const{
             return numberOfElements;
         }
@@ -140,15 +266,13 @@ class DynamicArray{
             return numberOfElements == 0;
         }
 
+        //keeps the storage for reuse
         void clear(){
-            delete[] container;
-            capacity = minCapacity;
-            container = new T[capacity];
-            numberOfElements = 0;
+            destroyAll();
         }
 
         void display(){
-            for(int i = 0; i < numberOfElements; i++)
+            for(unsigned i = 0; i < numberOfElements; i++)
                 cout << container[i] << endl;
         }
 };
@@ -0,0 +1,49 @@
+/*
+    A lock on a working directory that several threads share.
+
+    The lock is held by an owner rather than by a thread, and an owner
+    can take it again while it holds it. A connection of the daemon
+    owns it for the requests that touch files, and a background run
+    it starts (see runner.h) keeps it on the worker thread until the
+    run ends, so the connection's next requests go on while every
+    other connection waits for the files.
+*/
+
+#ifndef FILELOCK_H
+#define FILELOCK_H
+
+#include <mutex>
+#include <condition_variable>
+
+class FileLock{
+
+    private:
+        std::mutex mutex;
+        std::condition_variable released;
+
+        //who holds the lock and how many times, NULL and 0 when free
+        const void* owner;
+        unsigned holds;
+
+    public:
+        FileLock() : owner(NULL), holds(0){}
+
+        //Waits until the lock is free or already held by who
+        void lock(const void* who){
+            std::unique_lock<std::mutex> guard(mutex);
+            released.wait(guard, [&]{ return holds == 0 || owner == who; });
+            owner = who;
+            holds++;
+        }
+
+        //Gives back one hold, which can be taken by another thread
+        void unlock(){
+            std::lock_guard<std::mutex> guard(mutex);
+            if(holds > 0 && --holds == 0){
+                owner = NULL;
+                released.notify_all();
+            }
+        }
+};
+
+#endif
@@ -5,24 +5,39 @@
     This object reads lines entered by the user and parses
     them in order to execute the proper command with the
     respective parameters.
+
+    Commands can also be fed without prompts from a string
+    of ';' separated commands or from a script file (one command
+    per line). This is used for automating the assembler/simulator
+    from the shell.
+
+    Any command can be prefixed with "time" to display how long it took.
 */
 
 #ifndef INTERPRETER_H
 #define INTERPRETER_H
 
+#include <istream>
+#include <sstream>
 #include "util.h"
 #include "command.h"
+#include "stats.h"
 
 using std::cin;
+using std::istream;
 
 class Interpreter{
+    public:
+        //outcome of interpreting a single line
+        enum Status{ SUCCESS, FAILURE, UNRECOGNIZED, EXIT };
+
     //container of commands
     private:
         DynamicArray<Command> commands;
 
-        //signals TRUE if a command was executed
-        //signals FALSE if command was unrecognized
-        bool process(const DynamicArray<string>& parsedLine){
+        //signals TRUE if a command was found.
+        //succeeded is set to the outcome of the command.
+        bool process(const DynamicArray<string>& parsedLine, bool& succeeded){
             //find Command
             string first = parsedLine.at(0);
             for(unsigned i = 0; i < commands.size(); i++){
@@ -30,7 +45,7 @@ class Interpreter{
                 //command found
                 if( Util::isPrefix(first, comm->getName()) ){
                     if( first.length() >= comm->getNameTol() ){
-                        comm->process(parsedLine);
+                        succeeded = comm->process(parsedLine);
                         return true;
                     }
                 }
@@ -38,47 +53,136 @@ class Interpreter{
             return false;
         }
 
+        //Handles a failed line for the non-interactive modes.
+        //Returns true if the interpreter should keep going.
+        bool reportFailure(Status status, const string& line, bool keepGoing){
+            if(status == UNRECOGNIZED)
+                cout << "Command not recognized: " << line << endl;
+            else
+                cout << "\nCommand failed: " << line << endl;
+            return keepGoing;
+        }
+
     public:
         Interpreter(){}
 
-        void run(){
+        //Parses and executes a single line.
+        Status execute(const string& line){
             string delims = "\t ";
-            while(true){
-                bool errorFlag = false;
 
+            DynamicArray<string> parsedLine;
+            Util::parseLine(parsedLine, line, delims);
+
+            //nothing to do
+            if(parsedLine.size() == 0)
+                return SUCCESS;
+
+            //check for exit
+            string com = parsedLine.at(0);
+            if( Util::isPrefix(com, "exit") && com.length() > 2 )
+                return EXIT;
+
+            //time <command>
+            if(com == "time"){
+                DynamicArray<string> timedLine;
+                for(unsigned i = 1; i < parsedLine.size(); i++)
+                    timedLine.push_back(parsedLine.at(i));
+
+                if(timedLine.empty()){
+                    cout << "Error. Usage: time [command]";
+                    return FAILURE;
+                }
+
+                Timer timer;
+                bool succeeded = false;
+                bool found = process(timedLine, succeeded);
+                double seconds = timer.seconds();
+                if(!found)
+                    return UNRECOGNIZED;
+
+                cout << "\nTime: " << std::fixed << std::setprecision(6) << seconds << " s\n";
+                cout.unsetf(std::ios::floatfield);
+                return succeeded ? SUCCESS : FAILURE;
+            }
+
+            bool succeeded = false;
+            if(!process(parsedLine, succeeded))
+                return UNRECOGNIZED;
+
+            return succeeded ? SUCCESS : FAILURE;
+        }
+
+        //Interactive mode. Prompts the user until exit or end of input.
+        void run(){
+            while(true){
                 //prompt
                 cout << "\ncommand >>> ";
 
-                //read user input
+                //read user input. End of input behaves like exit.
                 string line;
-                getline(cin, line);
+                if(!getline(cin, line))
+                    break;
 
-                DynamicArray<string> parsedLine;
-                Util::parseLine(parsedLine, line, delims);
+                Status status = execute(line);
+                if(status == EXIT)
+                    break;
 
-                if(parsedLine.size() != 0){
-                    //check for exit
-                    string com = parsedLine.at(0);
-                    if( Util::isPrefix(com, "exit") && com.length() > 2 )
-                        break;
-
-                    //execute other commands
-                    //if the the process failed then set errorFlag.
-                    errorFlag = !process(parsedLine);
-                }
                 //unrecognized command
-                if(errorFlag)
+                if(status == UNRECOGNIZED)
                     cout << "Command not recognized. Enter 'help' for a list of available commands.";
             }
         }
 
+        //Non-interactive mode. Executes every line from the stream without prompts.
+        //Blank lines and lines starting with '#' are ignored.
+        //If keepGoing is false, stops at the first failing command.
+        //Returns the exit status for the process: 0 if every command succeeded, 1 otherwise.
+        int runScript(istream& script, bool keepGoing){
+            int exitStatus = 0;
+            string line;
+            while(getline(script, line)){
+                if(!line.empty() && line.at(0) == '#')
+                    continue;
+
+                Status status = execute(line);
+                if(status == EXIT)
+                    break;
+
+                if(status == FAILURE || status == UNRECOGNIZED){
+                    exitStatus = 1;
+                    if(!reportFailure(status, line, keepGoing))
+                        break;
+                }
+            }
+            cout << endl;
+            return exitStatus;
+        }
+
+        //Same as runScript but the commands are separated by ';'
+        int runCommands(const string& commands, bool keepGoing){
+            string script = commands;
+            for(size_t i = 0; i < script.length(); i++)
+                if(script[i] == ';')
+                    script[i] = '\n';
+
+            std::istringstream stream(script);
+            return runScript(stream, keepGoing);
+        }
+
         //Specify the name and number of parameters for the command and
         //pass the function that you want processed by the command
-        void addCommand(string name, unsigned params, unsigned nameTol, void(*execution)(const DynamicArray<string>&) ){
+        void addCommand(string name, unsigned params, unsigned nameTol, bool(*execution)(const DynamicArray<string>&) ){
             Command c(name, params, nameTol, execution);
             commands.push_back(c);
         }
 
+        //For commands with optional parameters
+        void addCommand(string name, unsigned minParams, unsigned maxParams, unsigned nameTol,
+                            bool(*execution)(const DynamicArray<string>&) ){
+            Command c(name, minParams, maxParams, nameTol, execution);
+            commands.push_back(c);
+        }
+
         void removeCommand(string name){
             commands.remove(Command(name));
         }
@@ -0,0 +1,208 @@
+
+/*
+    The relocating loader.
+
+    Reads an object file produced by the assembler and places it in the
+    memory of the current machine, either at the address it was assembled
+    for or at another address. When the program is moved, every address
+    field named by a modification record gets the relocation offset added.
+
+    Object file records:
+        H name(6) start(6) length(6)
+        T address(6) length(2) data
+        F address(6) count(6) value(2)      count bytes of one value
+        M address(6) length in half bytes(2)
+        E first executable address(6)
+*/
+
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include "codec.h"
+#include "util.h"
+#include "debuginfo.h"
+
+extern "C"{
+    #include "sicengine.h"
+}
+
+using std::ifstream;
+
+//A program resident in memory, after relocation
+struct Program{
+    string name;
+    int start;
+    int length;
+    int entry;
+
+    //bytes written by text and fill records
+    long bytesLoaded;
+
+    //added to the assembled addresses by the relocation
+    int offset;
+
+    //from the debug file of the object file, if there is one
+    std::shared_ptr<DebugInfo> debug;
+
+    Program() : name(""), start(0), length(0), entry(0), bytesLoaded(0), offset(0){}
+
+    bool overlaps(const Program& p) const{
+        return start < p.start + p.length && p.start < start + length;
+    }
+
+    bool contains(int address) const{
+        return address >= start && address < start + length;
+    }
+};
+
+class Loader{
+
+    private:
+        static bool field(const string& record, size_t pos, size_t len, int& dst){
+            return record.length() >= pos + len && Codec::parseInt(record.data() + pos, len, dst, 16);
+        }
+
+        static bool invalid(const string& record){
+            cout << "Error. Invalid record: " << record << "\n";
+            return false;
+        }
+
+        //Adds offset to the field of halfBytes half bytes that ends at the
+        //last byte of the bytes starting at address. An odd number of half
+        //bytes starts in the low half of the first byte.
+        static bool relocate(int address, int halfBytes, int offset){
+            int bytes = (halfBytes + 1) / 2;
+            if(halfBytes <= 0 || halfBytes > 6 || address < 0 || address + bytes > MSIZE)
+                return false;
+
+            BYTE data[3];
+            GetMemBlock(address, data, bytes);
+
+            long value = 0;
+            for(int i = 0; i < bytes; i++)
+                value = value << 8 | data[i];
+
+            long mask = (1L << (4 * halfBytes)) - 1;
+            long relocated = ((value & mask) + offset) & mask;
+            value = (value & ~mask) | relocated;
+
+            for(int i = bytes-1; i >= 0; i--){
+                data[i] = value & 0xFF;
+                value >>= 8;
+            }
+            PutMemBlock(address, data, bytes);
+            return true;
+        }
+
+    public:
+        //Loads the object file at path. If loadAddress is negative the program
+        //is loaded at its assembled address, otherwise it is relocated to
+        //loadAddress. program describes where the program ended up.
+        static bool load(const string& path, int loadAddress, Program& program){
+            ifstream objectfile(path);
+            if(!objectfile.is_open()){
+                cout << "Error. \"" << path << "\" file for source was not found.\n";
+                return false;
+            }
+
+            //header record
+            string record;
+            int start = 0;
+            if(!getline(objectfile, record) || record.empty() || record.at(0) != 'H' ||
+                    !field(record, 7, 6, start) || !field(record, 13, 6, program.length))
+                return invalid(record);
+
+            program.name = record.substr(1, 6);
+            while(!program.name.empty() && program.name.at(program.name.length()-1) == ' ')
+                program.name.erase(program.name.length()-1);
+
+            int offset = loadAddress < 0 ? 0 : loadAddress - start;
+            program.start = start + offset;
+            program.offset = offset;
+            if(program.start + program.length > MSIZE){
+                cout << "Error. The program does not fit in memory at that address.\n";
+                return false;
+            }
+
+            //NOTE:
+            //Every two charcters represents two hex digits which are 1 byte in size.
+            //Memory increases per byte.
+            int modifications = 0;
+            while(getline(objectfile, record)){
+                if(record.empty())
+                    continue;
+
+                int address = 0;
+                char type = record.at(0);
+
+                //end record reached
+                if(type == 'E'){
+                    //save first executable address
+                    if(!field(record, 1, 6, program.entry))
+                        return invalid(record);
+                    program.entry += offset;
+
+                    if(offset != 0 && modifications == 0)
+                        cout << "Warning. No modification records, addresses were not relocated.\n";
+
+                    //the assembler writes the debug file next to the object file
+                    std::shared_ptr<DebugInfo> debug(new DebugInfo());
+                    if(debug->open(DebugInfo::pathFor(path)))
+                        program.debug = debug;
+                    return true;
+                }
+                else if(type == 'T'){
+                    if(!field(record, 1, 6, address))
+                        return invalid(record);
+
+                    //decode the data portion of the text record in one pass.
+                    //The record length field (2 hex digits) limits it to 255 bytes.
+                    size_t dataLength = record.length() - 9;
+                    BYTE bytes[255];
+                    if(record.length() < 9 || dataLength > 2*sizeof(bytes) ||
+                            !Codec::hexDecode(record.data() + 9, dataLength, bytes))
+                        return invalid(record);
+
+                    address += offset;
+                    if(address < 0 || address + (long)dataLength/2 > MSIZE)
+                        return invalid(record);
+
+                    //load the bytes into memory
+                    PutMemBlock(static_cast<ADDRESS>(address), bytes, dataLength/2);
+                    program.bytesLoaded += dataLength/2;
+                }
+                else if(type == 'F'){
+                    int count = 0, value = 0;
+                    if(!field(record, 1, 6, address) || !field(record, 7, 6, count)
+                            || !field(record, 13, 2, value) || record.length() != 15)
+                        return invalid(record);
+
+                    address += offset;
+                    if(address < 0 || address + (long)count > MSIZE)
+                        return invalid(record);
+
+                    //the whole region at once
+                    memset(SICMemory() + address, value, count);
+                    program.bytesLoaded += count;
+                }
+                else if(type == 'M'){
+                    int halfBytes = 0;
+                    if(!field(record, 1, 6, address) || !field(record, 7, 2, halfBytes))
+                        return invalid(record);
+
+                    if(offset != 0 && !relocate(address + offset, halfBytes, offset))
+                        return invalid(record);
+                    modifications++;
+                }
+                else return invalid(record);
+            }
+
+            cout << "Error. Missing end record.\n";
+            return false;
+        }
+};
+
+#endif
@@ -0,0 +1,735 @@
+
+/*
+    Lockstep execution of many machines running the same program.
+
+    Every machine is a lane. The registers A, X, L and the condition
+    code of all lanes are kept as arrays (structure of arrays) and the
+    memories are interleaved, byte a of lane l at a * lanes + l, so a
+    load or a store at the same address touches consecutive bytes of
+    every lane. An instruction is fetched and decoded once for all lanes
+    and executed on 8 lanes at a time with AVX2 (compile with -mavx2),
+    or with plain loops otherwise. The memories are interleaved a page
+    at a time, when the group first touches the page, and only the pages
+    it wrote are copied back to the machines, so a short program does
+    not pay for the whole memory of every lane.
+
+    Lockstep covers the standard SIC instructions (simple and indexed
+    addressing): LDA, LDX, LDL, LDCH, STA, STX, STL, STCH, ADD, SUB,
+    COMP, TIX, J, JEQ, JGT, JLT, JSUB, RSUB, TD, RD and WD. The devices
+    of each lane are the devices of its machine.
+
+    A lane leaves the group and finishes in the scalar engine when
+        - its PC diverges from the PC that most lanes follow
+        - an instruction would fail for it (overflow, bad address),
+          so the engine reports the fault
+        - it reads, writes or tests the counter device (07), whose
+          readings the engine keeps
+    Every lane leaves when the group reaches an instruction lockstep does
+    not cover. The instructions are taken from the memory of one lane,
+    the program must not modify its own code differently in each lane.
+*/
+
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#include "dynamic_array.h"
+#include "util.h"
+
+extern "C"{
+    #include "sicengine.h"
+}
+
+class Lockstep{
+
+    private:
+        //range of a 24 bit word
+        static const int32_t wordMax = 0x7FFFFF;
+        static const int32_t wordMin = -0x800000;
+
+        //lanes are processed in blocks of 8
+        static const unsigned block = 8;
+
+        //the interleaved memory is filled and copied back by pages
+        static const int pageBits = 8;
+        static const long page = 1L << pageBits;
+        static const long pages = MSIZE >> pageBits;
+
+        //pages are transposed in tiles of tile lanes by tile bytes
+        static const unsigned tile = 16;
+
+        enum LaneState{ RUNNING, EJECTED, ENDED };
+
+        //condition codes, as in the status word
+        enum{ CC_LT = 1, CC_EQ = 2, CC_GT = 3 };
+
+        enum Opcode{
+            LDA = 0x00, LDX = 0x04, LDL = 0x08, STA = 0x0C, STX = 0x10, STL = 0x14,
+            ADD = 0x18, SUB = 0x1C, COMP = 0x28, TIX = 0x2C, JEQ = 0x30, JGT = 0x34,
+            JLT = 0x38, J = 0x3C, JSUB = 0x48, RSUB = 0x4C, LDCH = 0x50, STCH = 0x54,
+            RD = 0xD8, WD = 0xDC, TD = 0xE0
+        };
+
+        DynamicArray<SICMACHINE*> machines;
+
+        //number of lanes, a multiple of tile (and so of block)
+        unsigned lanes;
+
+        int32_t* A;
+        int32_t* X;
+        int32_t* L;
+        int32_t* CC;
+
+        //per lane scratch: operand, result, effective address, next PC
+        int32_t* operand;
+        int32_t* result;
+        int32_t* address;
+        int32_t* next;
+
+        //MSIZE bytes per lane, interleaved. A page is only brought in
+        //from the machines when the group first touches it, and only the
+        //pages the group wrote are copied back when a lane leaves.
+        BYTE* memory;
+        BYTE present[pages];
+        BYTE dirty[pages];
+        BYTE* state;
+
+        ADDRESS pc;
+        unsigned leader;
+        unsigned running;
+
+        //instructions executed by the group, and their simulated cycles
+        unsigned long steps;
+        unsigned long cycles;
+
+        //opcode of the instruction being executed
+        int current;
+
+        //lanes that left the group for the scalar engine
+        unsigned ejected;
+
+        std::atomic<bool> stopping;
+
+        Lockstep(const Lockstep&);
+        Lockstep& operator=(const Lockstep&);
+
+        template<typename T>
+        static T* allocate(size_t count, bool clear = true){
+            size_t bytes = (count * sizeof(T) + 31) / 32 * 32;
+            T* p = static_cast<T*>(aligned_alloc(32, bytes));
+            if(clear)
+                std::memset(p, 0, bytes);
+            return p;
+        }
+
+        static int32_t extend(int32_t value){
+            return static_cast<int32_t>(static_cast<uint32_t>(value) << 8) >> 8;
+        }
+
+        static int32_t fromWord(const BYTE* w){
+            return extend(w[0] << 16 | w[1] << 8 | w[2]);
+        }
+
+        static void toWord(int32_t value, BYTE* w){
+            w[0] = (value >> 16) & 0xFF;
+            w[1] = (value >> 8) & 0xFF;
+            w[2] = value & 0xFF;
+        }
+
+        static int32_t compare(int32_t a, int32_t b){
+            return a < b ? CC_LT : (a == b ? CC_EQ : CC_GT);
+        }
+
+        BYTE& at(long a, unsigned lane){
+            return memory[a * lanes + lane];
+        }
+
+        int32_t wordAt(long a, unsigned lane){
+            return extend(at(a, lane) << 16 | at(a+1, lane) << 8 | at(a+2, lane));
+        }
+
+#if defined(__AVX2__)
+        //Transposes tile rows of tile bytes: byte a + j of row i goes to
+        //out[j * stride + i]. Four rounds of interleaving the rows i and
+        //i + 8 do it.
+        static void transpose(const BYTE* const* rows, long a, BYTE* out, size_t stride){
+            __m128i r[tile], t[tile];
+            for(unsigned i = 0; i < tile; i++)
+                r[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[i] + a));
+            for(int round = 0; round < 4; round++){
+                for(unsigned i = 0; i < tile / 2; i++){
+                    t[2 * i] = _mm_unpacklo_epi8(r[i], r[i + tile / 2]);
+                    t[2 * i + 1] = _mm_unpackhi_epi8(r[i], r[i + tile / 2]);
+                }
+                std::memcpy(r, t, sizeof r);
+            }
+            for(unsigned j = 0; j < tile; j++)
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + j * stride), r[j]);
+        }
+#else
+        static void transpose(const BYTE* const* rows, long a, BYTE* out, size_t stride){
+            for(unsigned i = 0; i < tile; i++)
+                for(unsigned j = 0; j < tile; j++)
+                    out[j * stride + i] = rows[i][a + j];
+        }
+#endif
+
+        //Brings page p of every machine into the interleaved memory, a
+        //tile of lanes at a time. The padding lanes get zeros.
+        void bring(long p){
+            static const BYTE zeros[page] = {0};
+            const BYTE* rows[tile];
+            BYTE* base = &at(p << pageBits, 0);
+            for(unsigned l = 0; l < lanes; l += tile){
+                for(unsigned i = 0; i < tile; i++){
+                    if(l + i < machines.size()){
+                        SICSelect(machines.at(l + i));
+                        rows[i] = SICMemory() + (p << pageBits);
+                    }
+                    else
+                        rows[i] = zeros;
+                }
+                for(long a = 0; a < page; a += tile)
+                    transpose(rows, a, base + a * lanes + l, lanes);
+            }
+            present[p] = 1;
+        }
+
+        //Makes the bytes [a, a + length) of every lane present
+        void need(long a, long length){
+            for(long p = a >> pageBits; p <= (a + length - 1) >> pageBits; p++)
+                if(!present[p])
+                    bring(p);
+        }
+
+        void wrote(long a, long length){
+            for(long p = a >> pageBits; p <= (a + length - 1) >> pageBits; p++)
+                dirty[p] = 1;
+        }
+
+        //Copies the state of a lane back to its machine, which the
+        //scalar engine can then continue from pc. completed tells if
+        //the current instruction was executed.
+        void leave(unsigned lane, ADDRESS resume, bool completed, LaneState how){
+            SICSelect(machines.at(lane));
+
+            //the machine still holds the pages the group did not write
+            BYTE* own = SICMemory();
+            for(long p = 0; p < pages; p++){
+                if(!dirty[p])
+                    continue;
+                const BYTE* column = &at(p << pageBits, lane);
+                for(long a = 0; a < page; a++)
+                    own[(p << pageBits) + a] = column[a * lanes];
+            }
+
+            WORD registers[6];
+            GetReg(registers);
+            toWord(A[lane], registers[0]);
+            toWord(X[lane], registers[1]);
+            toWord(L[lane], registers[2]);
+            PutReg(registers);
+            PutPC(resume);
+            PutCC(CC[lane] == CC_LT ? '<' : (CC[lane] == CC_EQ ? '=' : (CC[lane] == CC_GT ? '>' : '?')));
+            SICAddCount(steps + (completed ? 1 : 0));
+            SICAddCycles(cycles + (completed ? SICOpCycles(current) : 0));
+
+            state[lane] = how;
+            running--;
+            if(how == EJECTED)
+                ejected++;
+        }
+
+        void leaveAll(ADDRESS resume){
+            for(unsigned l = 0; l < machines.size(); l++)
+                if(state[l] == RUNNING)
+                    leave(l, resume, false, EJECTED);
+        }
+
+        void findLeader(){
+            while(leader < machines.size() && state[leader] != RUNNING)
+                leader++;
+        }
+
+        //Ejects the running lanes whose flag is set, before the
+        //instruction at pc is executed for them
+        void ejectFlagged(const int32_t* flags){
+            for(unsigned l = 0; l < machines.size(); l++)
+                if(flags[l] && state[l] == RUNNING)
+                    leave(l, pc, false, EJECTED);
+        }
+
+        //Computes the effective address of every lane. Lanes for which it
+        //is not below limit leave the group. Returns false if no lane is left.
+        //The operand bytes of every lane are made present.
+        bool addresses(bool indexed, int32_t target, int32_t limit){
+            long size = MSIZE - limit;
+            if(!indexed){
+                if(target > limit){
+                    leaveAll(pc);
+                    return false;
+                }
+                need(target, size);
+                return true;
+            }
+            for(unsigned l = 0; l < machines.size(); l++){
+                if(state[l] != RUNNING)
+                    continue;
+                int32_t a = target + X[l];
+                if(a < 0 || a > limit)
+                    leave(l, pc, false, EJECTED);
+                else{
+                    address[l] = a;
+                    need(a, size);
+                }
+            }
+            findLeader();
+            return running > 0;
+        }
+
+        //Loads the word (or byte) operand of every lane
+        void load(bool indexed, int32_t target, bool byte){
+            if(indexed){
+                for(unsigned l = 0; l < lanes; l++)
+                    if(state[l] == RUNNING)
+                        operand[l] = byte ? at(address[l], l) : wordAt(address[l], l);
+                return;
+            }
+            if(byte){
+                const BYTE* p = &at(target, 0);
+                for(unsigned l = 0; l < lanes; l++)
+                    operand[l] = p[l];
+                return;
+            }
+#if defined(__AVX2__)
+            const BYTE* p0 = &at(target, 0);
+            const BYTE* p1 = p0 + lanes;
+            const BYTE* p2 = p1 + lanes;
+            for(unsigned l = 0; l < lanes; l += block){
+                __m256i b0 = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p0 + l)));
+                __m256i b1 = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p1 + l)));
+                __m256i b2 = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p2 + l)));
+                __m256i w = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(b0, 16), _mm256_slli_epi32(b1, 8)), b2);
+                w = _mm256_srai_epi32(_mm256_slli_epi32(w, 8), 8);
+                _mm256_store_si256(reinterpret_cast<__m256i*>(operand + l), w);
+            }
+#else
+            for(unsigned l = 0; l < lanes; l++)
+                operand[l] = wordAt(target, l);
+#endif
+        }
+
+#if defined(__AVX2__)
+        //the low byte of each of the 8 words, in 8 bytes
+        static __m128i lowBytes(__m256i words){
+            const __m256i pick = _mm256_setr_epi8(
+                0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+            __m256i packed = _mm256_shuffle_epi8(words, pick);
+            packed = _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 1, 1, 1, 1, 1, 1));
+            return _mm256_castsi256_si128(packed);
+        }
+#endif
+
+        //Stores a register (or its low byte) of every lane
+        void store(const int32_t* reg, bool indexed, int32_t target, bool byte){
+            if(indexed){
+                for(unsigned l = 0; l < lanes; l++){
+                    if(state[l] != RUNNING)
+                        continue;
+                    wrote(address[l], byte ? 1 : 3);
+                    if(byte)
+                        at(address[l], l) = reg[l] & 0xFF;
+                    else{
+                        at(address[l], l) = (reg[l] >> 16) & 0xFF;
+                        at(address[l] + 1, l) = (reg[l] >> 8) & 0xFF;
+                        at(address[l] + 2, l) = reg[l] & 0xFF;
+                    }
+                }
+                return;
+            }
+            wrote(target, byte ? 1 : 3);
+            if(byte){
+                BYTE* p = &at(target, 0);
+                for(unsigned l = 0; l < lanes; l++)
+                    p[l] = reg[l] & 0xFF;
+                return;
+            }
+#if defined(__AVX2__)
+            BYTE* p0 = &at(target, 0);
+            BYTE* p1 = p0 + lanes;
+            BYTE* p2 = p1 + lanes;
+            for(unsigned l = 0; l < lanes; l += block){
+                __m256i w = _mm256_load_si256(reinterpret_cast<const __m256i*>(reg + l));
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(p0 + l), lowBytes(_mm256_srli_epi32(w, 16)));
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(p1 + l), lowBytes(_mm256_srli_epi32(w, 8)));
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(p2 + l), lowBytes(w));
+            }
+#else
+            for(unsigned l = 0; l < lanes; l++){
+                at(target, l) = (reg[l] >> 16) & 0xFF;
+                at(target + 1, l) = (reg[l] >> 8) & 0xFF;
+                at(target + 2, l) = reg[l] & 0xFF;
+            }
+#endif
+        }
+
+        //result = reg + operand (negated first for SUB, the way the engine
+        //does it). Lanes that overflow leave the group, so the engine
+        //reports the overflow. Returns false if no lane is left.
+        bool add(const int32_t* reg, bool subtract){
+            int32_t* overflow = address;    //free once the operand is loaded
+#if defined(__AVX2__)
+            const __m256i max = _mm256_set1_epi32(wordMax);
+            const __m256i min = _mm256_set1_epi32(wordMin);
+            int any = 0;
+            for(unsigned l = 0; l < lanes; l += block){
+                __m256i a = _mm256_load_si256(reinterpret_cast<const __m256i*>(reg + l));
+                __m256i b = _mm256_load_si256(reinterpret_cast<const __m256i*>(operand + l));
+                if(subtract){
+                    b = _mm256_sub_epi32(_mm256_setzero_si256(), b);
+                    b = _mm256_srai_epi32(_mm256_slli_epi32(b, 8), 8);
+                }
+                __m256i sum = _mm256_add_epi32(a, b);
+                __m256i bad = _mm256_or_si256(_mm256_cmpgt_epi32(sum, max), _mm256_cmpgt_epi32(min, sum));
+                _mm256_store_si256(reinterpret_cast<__m256i*>(result + l), sum);
+                _mm256_store_si256(reinterpret_cast<__m256i*>(overflow + l), bad);
+                any |= _mm256_movemask_epi8(bad);
+            }
+#else
+            int any = 0;
+            for(unsigned l = 0; l < lanes; l++){
+                int32_t b = subtract ? extend(-operand[l]) : operand[l];
+                result[l] = reg[l] + b;
+                overflow[l] = result[l] > wordMax || result[l] < wordMin;
+                any |= overflow[l];
+            }
+#endif
+            if(any){
+                ejectFlagged(overflow);
+                findLeader();
+            }
+            return running > 0;
+        }
+
+        //CC = compare(reg, operand)
+        void compareAll(const int32_t* reg){
+#if defined(__AVX2__)
+            const __m256i one = _mm256_set1_epi32(1);
+            const __m256i two = _mm256_set1_epi32(2);
+            for(unsigned l = 0; l < lanes; l += block){
+                __m256i a = _mm256_load_si256(reinterpret_cast<const __m256i*>(reg + l));
+                __m256i b = _mm256_load_si256(reinterpret_cast<const __m256i*>(operand + l));
+                __m256i eq = _mm256_cmpeq_epi32(a, b);
+                __m256i gt = _mm256_and_si256(_mm256_cmpgt_epi32(a, b), two);
+                __m256i cc = _mm256_add_epi32(_mm256_sub_epi32(one, eq), gt);
+                _mm256_store_si256(reinterpret_cast<__m256i*>(CC + l), cc);
+            }
+#else
+            for(unsigned l = 0; l < lanes; l++)
+                CC[l] = compare(reg[l], operand[l]);
+#endif
+        }
+
+        //Runs RD, WD or TD of every lane on the devices of its machine.
+        //Lanes whose device fails end with the fault. Lanes that use the
+        //counter device leave, its readings count what their machine ran.
+        void charIO(int opcode, bool indexed, int32_t target, ADDRESS after){
+            for(unsigned l = 0; l < machines.size(); l++){
+                if(state[l] != RUNNING)
+                    continue;
+                BYTE device = at(indexed ? address[l] : target, l);
+                if(device == 0x07 || device == 0xF7){
+                    leave(l, pc, false, EJECTED);
+                    continue;
+                }
+
+                WORD a;
+                toWord(A[l], a);
+                SICSelect(machines.at(l));
+                PutPC(after);
+                PutCC(CC[l] == CC_LT ? '<' : (CC[l] == CC_EQ ? '=' : (CC[l] == CC_GT ? '>' : '?')));
+                int fault = SICCharIO(opcode, device, a);
+                A[l] = fromWord(a);
+
+                char cc = GetCC();
+                CC[l] = cc == '<' ? CC_LT : (cc == '=' ? CC_EQ : (cc == '>' ? CC_GT : 0));
+                if(fault != 0)
+                    leave(l, after, true, ENDED);
+            }
+            findLeader();
+        }
+
+        //Continues with the PC most lanes have after a jump.
+        //The other lanes leave the group.
+        void converge(){
+            ADDRESS first = next[leader];
+            ADDRESS second = first;
+            unsigned firstCount = 0;
+            unsigned secondCount = 0;
+            for(unsigned l = leader; l < machines.size(); l++){
+                if(state[l] != RUNNING)
+                    continue;
+                if((ADDRESS)next[l] == first)
+                    firstCount++;
+                else{
+                    if(second == first)
+                        second = next[l];
+                    if((ADDRESS)next[l] == second)
+                        secondCount++;
+                }
+            }
+
+            ADDRESS chosen = secondCount > firstCount ? second : first;
+            for(unsigned l = leader; l < machines.size(); l++)
+                if(state[l] == RUNNING && (ADDRESS)next[l] != chosen)
+                    leave(l, next[l], true, EJECTED);
+            pc = chosen;
+            findLeader();
+        }
+
+        //Executes the instruction at pc for every lane in the group.
+        //Returns false once no lane is left.
+        bool step(){
+            //the engine fails the fetch of an instruction that ends
+            //this close to the end of memory
+            if(pc + 3 > MSIZE - 2){
+                leaveAll(pc);
+                return false;
+            }
+
+            need(pc, 3);
+            BYTE b0 = at(pc, leader);
+            BYTE b1 = at(pc + 1, leader);
+            BYTE b2 = at(pc + 2, leader);
+            int opcode = b0 & 0xFC;
+            bool indexed = (b1 & 0x80) != 0;
+            int32_t target = (b1 & 0x7F) << 8 | b2;
+            ADDRESS after = pc + 3;
+            current = opcode;
+
+            //only simple and indexed SIC addressing
+            if((b0 & 3) != 0){
+                leaveAll(pc);
+                return false;
+            }
+
+            bool jumped = false;
+            switch(opcode){
+                case LDA: case LDX: case LDL:
+                case ADD: case SUB: case COMP: case TIX:
+                    if(!addresses(indexed, target, MSIZE - 3))
+                        return false;
+                    load(indexed, target, false);
+
+                    if(opcode == LDA)       std::memcpy(A, operand, lanes * sizeof(int32_t));
+                    else if(opcode == LDX)  std::memcpy(X, operand, lanes * sizeof(int32_t));
+                    else if(opcode == LDL)  std::memcpy(L, operand, lanes * sizeof(int32_t));
+                    else if(opcode == COMP) compareAll(A);
+                    else if(opcode == TIX){
+                        //X + 1, compared with the operand
+                        int32_t* loaded = operand;
+                        operand = next;
+                        for(unsigned l = 0; l < lanes; l++)
+                            operand[l] = 1;
+                        bool left = add(X, false);
+                        operand = loaded;
+                        if(!left)
+                            return false;
+                        std::memcpy(X, result, lanes * sizeof(int32_t));
+                        compareAll(X);
+                    }
+                    else{
+                        if(!add(A, opcode == SUB))
+                            return false;
+                        std::memcpy(A, result, lanes * sizeof(int32_t));
+                    }
+                    break;
+
+                case LDCH:
+                    if(!addresses(indexed, target, MSIZE - 1))
+                        return false;
+                    load(indexed, target, true);
+                    for(unsigned l = 0; l < lanes; l++)
+                        A[l] = extend((A[l] & 0xFFFF00) | operand[l]);
+                    break;
+
+                case STA: case STX: case STL:
+                    if(!addresses(indexed, target, MSIZE - 3))
+                        return false;
+                    store(opcode == STA ? A : (opcode == STX ? X : L), indexed, target, false);
+                    break;
+
+                case STCH:
+                    if(!addresses(indexed, target, MSIZE - 1))
+                        return false;
+                    store(A, indexed, target, true);
+                    break;
+
+                case RD: case WD: case TD:
+                    if(!addresses(indexed, target, MSIZE - 3))
+                        return false;
+                    charIO(opcode, indexed, target, after);
+                    break;
+
+                case J: case JEQ: case JGT: case JLT: case JSUB:{
+                    int condition = opcode == JEQ ? CC_EQ : (opcode == JGT ? CC_GT : (opcode == JLT ? CC_LT : 0));
+                    for(unsigned l = 0; l < machines.size(); l++){
+                        if(state[l] != RUNNING)
+                            continue;
+                        bool taken = condition == 0 || CC[l] == condition;
+                        int32_t a = indexed ? target + X[l] : target;
+                        //the engine fails a jump out of memory
+                        if(taken && (a < 0 || a > MSIZE - 2))
+                            leave(l, pc, false, EJECTED);
+                        else
+                            next[l] = taken ? a : after;
+                    }
+                    findLeader();
+                    if(running == 0)
+                        return false;
+                    if(opcode == JSUB)
+                        for(unsigned l = 0; l < lanes; l++)
+                            L[l] = after;
+                    jumped = true;
+                    break;
+                }
+
+                case RSUB:
+                    for(unsigned l = 0; l < machines.size(); l++){
+                        if(state[l] != RUNNING)
+                            continue;
+                        int32_t ret = L[l] & 0xFFFFFF;
+                        //the return address X'FFFFFF' ends the program
+                        if(ret == 0xFFFFFF)
+                            leave(l, after, true, ENDED);
+                        else if(ret > MSIZE)
+                            leave(l, pc, false, EJECTED);
+                        else
+                            next[l] = ret;
+                    }
+                    findLeader();
+                    if(running == 0)
+                        return false;
+                    jumped = true;
+                    break;
+
+                default:
+                    leaveAll(pc);
+                    return false;
+            }
+
+            if(running == 0)
+                return false;
+            if(jumped)
+                converge();
+            else
+                pc = after;
+            steps++;
+            cycles += SICOpCycles(opcode);
+            return running > 0;
+        }
+
+    public:
+        Lockstep() : lanes(0), A(NULL), X(NULL), L(NULL), CC(NULL), operand(NULL),
+            result(NULL), address(NULL), next(NULL), memory(NULL), state(NULL),
+            pc(0), leader(0), running(0), steps(0), cycles(0), current(0), ejected(0),
+            stopping(false){}
+
+        ~Lockstep(){
+            free(A); free(X); free(L); free(CC);
+            free(operand); free(result); free(address); free(next);
+            free(memory); free(state);
+        }
+
+        //Adds a machine with the program loaded in its memory
+        void add(SICMACHINE* machine){
+            machines.push_back(machine);
+        }
+
+        //Runs every machine from entry until its program ends. The lanes
+        //that left the group are then finished by the scalar engine.
+        //Returns the number of instructions executed.
+        unsigned long run(ADDRESS entry){
+            SICMACHINE* previous = SICCurrent();
+            lanes = (machines.size() + tile - 1) / tile * tile;
+
+            A = allocate<int32_t>(lanes);
+            X = allocate<int32_t>(lanes);
+            L = allocate<int32_t>(lanes);
+            CC = allocate<int32_t>(lanes);
+            operand = allocate<int32_t>(lanes);
+            result = allocate<int32_t>(lanes);
+            address = allocate<int32_t>(lanes);
+            next = allocate<int32_t>(lanes);
+            memory = allocate<BYTE>(static_cast<size_t>(MSIZE) * lanes, false);
+            std::memset(present, 0, sizeof present);
+            std::memset(dirty, 0, sizeof dirty);
+            state = allocate<BYTE>(lanes);
+
+            //the padding lanes never run
+            std::memset(state, ENDED, lanes);
+
+            unsigned long before = 0;
+            for(unsigned l = 0; l < machines.size(); l++){
+                SICSelect(machines.at(l));
+                before += SICCount();
+
+                WORD registers[6];
+                GetReg(registers);
+                A[l] = fromWord(registers[0]);
+                X[l] = fromWord(registers[1]);
+                L[l] = fromWord(registers[2]);
+                char cc = GetCC();
+                CC[l] = cc == '<' ? CC_LT : (cc == '=' ? CC_EQ : (cc == '>' ? CC_GT : 0));
+                state[l] = RUNNING;
+            }
+
+            running = machines.size();
+            leader = 0;
+            steps = 0;
+            cycles = 0;
+            ejected = 0;
+            pc = entry;
+
+            //the engine is told when the process shuts down (SICStopAll)
+            while(running > 0 && !stopping && step())
+                if(SICClosing())
+                    stopping = true;
+            if(stopping)
+                leaveAll(pc);
+
+            //the scalar engine finishes the lanes that left
+            unsigned long total = 0;
+            for(unsigned l = 0; l < machines.size(); l++){
+                SICSelect(machines.at(l));
+                if(state[l] == EJECTED && !stopping)
+                    SICSlice(0);
+                total += SICCount();
+            }
+            SICSelect(previous);
+            return total - before;
+        }
+
+        //Ends a run at the next instruction. Safe to call from a signal handler.
+        void stop(){
+            stopping = true;
+        }
+
+        //instructions executed by the lanes in lockstep, per lane
+        unsigned long getSteps() const{
+            return steps;
+        }
+
+        unsigned getEjected() const{
+            return ejected;
+        }
+};
+
+#endif
@@ -24,88 +24,156 @@
     Each command takes in a list of strings.
         1st element of the list is the command entered such as load
         The rest of the elements are the paramters. This could be a file path.
+    Each command returns true if it succeeded. The non-interactive modes
+    use this to stop on errors and to report an exit status.
+
+    Usage:
+        sicasm                          interactive prompt
+        sicasm -c "cmd1; cmd2; ..."     run the ';' separated commands
+        sicasm --script file            run the commands in file (one per line)
+        sicasm --daemon socket [--threads n]
+                                        serve the commands to clients (daemon.h)
+        sicasm --connect socket [-c "..." | --script file]
+                                        run the commands in a daemon, or
+                                        prompt for them
+    Add -k (--keep-going) to continue after a failing command.
+    The exit status is 0 if every command succeeded, 1 if any failed
+    and 2 for invalid arguments.
 
     Note: Data in the object file is all in hexadecimal.
 */
 
+#include <csignal>
 #include "interpreter.h"
+#include "codec.h"
 #include "assembler.h"
+#include "runner.h"
+#include "session.h"
+#include "memdump.h"
+#include "loader.h"
+#include "stats.h"
+#include "scheduler.h"
+#include "lockstep.h"
+#include "multiprocessor.h"
+#include "services.h"
+#include "cache.h"
+#include "runcache.h"
+#include "watch.h"
+#include "daemon.h"
+#include <dirent.h>
+#include <algorithm>
 
 extern "C"{
     #include "sicengine.h"
 }
 
-/*Globals for convenience among instructions*/
-string s_firstAddress = "";
-
-/*These are the implemented commands for the interpreter.*/
+/*Globals for convenience among instructions. They are per thread:
+  the daemon serves each client on a thread of its own.*/
+thread_local Stats stats;
+thread_local Runner runner(&stats.run);
 
-//Loads the object file specified (the parameter).
-//It will take the data from the object file and load
-//the necessary bytes in the SIC memory.
-void load(const DynamicArray<string>& command){
-    //reset data
-    s_firstAddress = "";
+//created by main() once the simulator is initialized, or for
+//each connection to the daemon
+thread_local SessionTable* sessions = NULL;
 
-    //the object file path is the 1st parameter
-    ifstream objectfile(command.at(1));
+//set while the "schedule" command runs its machines
+Scheduler* scheduler = NULL;
 
-    if(objectfile.is_open()){
-        string s_textRecord;
+//set while the "sweep" command runs its machines in lockstep
+Lockstep* lockstep = NULL;
 
-        //ignore the header record
-        getline(objectfile, s_textRecord);
+//set while the "cpus" command runs
+Multiprocessor* multiprocessor = NULL;
 
-        //NOTE:
-        //Every two charcters represents two hex digits which are 1 byte in size.
-        //Memory increases per byte.
+//set while "assemble --watch" runs
+Watcher* watcher = NULL;
 
-        //go through all text records
-        while(getline(objectfile, s_textRecord)){
+//set while the process serves clients (sicasm --daemon)
+Daemon* daemonServer = NULL;
 
-            //end record reached
-            if(s_textRecord.at(0) == 'E'){
-                //save first executable address
-                s_firstAddress = s_textRecord.substr(1, 6);
-                break;
-            }
+//Ctrl-C pauses a run in progress. Otherwise it terminates as usual.
+void interrupt(int signum){
+    if(daemonServer != NULL)
+        daemonServer->stop();
+    else if(scheduler != NULL)
+        scheduler->stop();
+    else if(lockstep != NULL)
+        lockstep->stop();
+    else if(multiprocessor != NULL)
+        multiprocessor->stop();
+    else if(watcher != NULL)
+        watcher->stop();
+    else if(SICRunning())
+        SICStop();
+    else{
+        signal(signum, SIG_DFL);
+        raise(signum);
+    }
+}
 
-            //obtain address from the record
-            string s_address = s_textRecord.substr(1, 6);
+//The messages of the engine (faults, single steps) go to the cout of
+//the thread running the machine, so a daemon client sees them
+void print(const char* text){
+    cout << text;
+}
 
-            //get the data portion of the text record
-            string s_byteData = s_textRecord.substr(9);
+/*These are the implemented commands for the interpreter.*/
 
-            string s_byte;
-            int i_address = 0;
-            int i_byte = 0;
+//Loads the object file specified (the parameter).
+//It will take the data from the object file and load
+//the necessary bytes in the SIC memory.
+//  load [file] at [address]   relocates the program to address (hex)
+bool load(const DynamicArray<string>& command){
+    if(runner.isActive()){
+        cout << "The machine is running. Use 'stop' first.\n";
+        return false;
+    }
 
-            //convert string address to a numerical value
-            Util::stringToInt(s_address, i_address, 16);
+    int loadAddress = -1;
+    if(command.size() == 4){
+        if(command.at(2) != "at" || !Codec::parseInt(command.at(3), loadAddress, 16)){
+            cout << "Error. Usage: load [file] at [address]\n";
+            return false;
+        }
+    }
+    else if(command.size() != 2){
+        cout << "Error. Usage: load [file] [at address]\n";
+        return false;
+    }
 
-            //iterate through all byte data of current text record
-            for(unsigned i = 0; i < s_byteData.length(); i += 2, i_address++){
+    //reset data
+    Session& session = sessions->current();
+    session.firstAddress = "";
 
-                //add two characters which is 1 byte
-                s_byte = "";
-                s_byte.push_back(s_byteData[i]);
-                s_byte.push_back(s_byteData[i+1]);
+    //the object file path is the 1st parameter
+    Timer timer;
+    Program program;
+    bool loaded = Loader::load(command.at(1), loadAddress, program);
+    stats.load.add(timer.seconds());
+    stats.bytesLoaded += program.bytesLoaded;
+    if(!loaded)
+        return false;
 
-                //Do necessary conversions
-                Util::stringToInt(s_byte, i_byte, 16);
-                BYTE b = static_cast<BYTE>(i_byte);
-                ADDRESS a = static_cast<ADDRESS>(i_address);
+    session.addProgram(program);
+    return true;
+}
 
-                //load the byte into memory
-                PutMem(a, &b, 0);
-            }
-        }
-        objectfile.close();
+//program list | program use <name>
+//Switches between the programs resident in the current session.
+bool programs(const DynamicArray<string>& command){
+    Session& session = sessions->current();
+    if(command.at(1) == "list" && command.size() == 2){
+        session.displayPrograms();
+        return true;
     }
-    //object file failed to open
-    else{
-         cout << "Error. \"" << command.at(1) << "\" file for source was not found.\n";
+    if(command.at(1) == "use" && command.size() == 3){
+        if(session.useProgram(command.at(2)))
+            return true;
+        cout << "Error. Program \"" << command.at(2) << "\" is not resident.\n";
+        return false;
     }
+    cout << "Error. Usage: program list | program use <name>\n";
+    return false;
 }
 
 //Uses the object file loaded from the command "load".
@@ -113,99 +181,951 @@ void load(const DynamicArray<string>& command){
 //The second line should always be the 1st text record.
 //This command will execute the object file prodcued
 //by the assembler.
-void exec(const DynamicArray<string>& command){
+//"execute &" runs the program in the background.
+//"execute --memo" replays an identical earlier run from the run cache
+//instead of executing it (see runcache.h).
+//Fails if the machine stopped because of a fault.
+bool exec(const DynamicArray<string>& command){
+    bool background = false, memo = false;
+    if(command.size() == 2){
+        if(command.at(1) == "&")
+            background = true;
+        else if(command.at(1) == "--memo")
+            memo = true;
+        else{
+            cout << "Error. Usage: execute [& | --memo]\n";
+            return false;
+        }
+    }
+
+    const string& s_firstAddress = sessions->current().firstAddress;
+
     //there is a specified starting address to start execution
     if(!s_firstAddress.empty()){
         //convert the address (which is base 16) to
         //a numerical value
         int i_address = 0;
-        Util::stringToInt(s_firstAddress, i_address, 16);
+        Codec::parseInt(s_firstAddress, i_address, 16);
         ADDRESS a = static_cast<ADDRESS>(i_address);
 
         //Execute the program
-        SICRun(&a, FALSE);
+        if(!runner.isActive())
+            SICClearCount();
+        if(!memo)
+            return runner.start(a, background);
+
+        //a replayed run prints what the executed one did, so only a
+        //run kept out of the cache is reported
+        RunCache cache;
+        bool succeeded = runner.start(a, false, &cache);
+        if(cache.outcome() == RunCache::replayed)
+            stats.runsReplayed++;
+        else if(cache.outcome() == RunCache::stored)
+            stats.runsStored++;
+        else
+            cout << "Not cached: " << cache.reason() << ".\n";
+        return succeeded;
     }
     else cout << "No starting address supplied from the object file.\n";
+    return false;
+}
+
+//Where address is in the source of the program that holds it, for example
+//"RLOOP+3  copy.asm:25  code". False if the program has no debug information.
+bool sourceOf(int address, string& place, string& source){
+    const Program* program = sessions->current().programAt(address);
+    if(program == NULL || !program->debug)
+        return false;
+
+    const DebugInfo& debug = *program->debug;
+    int assembled = address - program->offset;
+    int line = 0, offset = 0;
+    string symbol;
+    std::stringstream text;
+    if(debug.symbolAt(assembled, symbol, offset))
+        text << symbol << (offset != 0 ? "+" + Codec::hexValue(offset, 1) : "") << "  ";
+    if(debug.lineAt(assembled, line, source))
+        text << debug.sourcePath() << ":" << line << "  ";
+    else
+        source = "";
+    int kind = debug.kindAt(assembled);
+    text << (kind == 1 ? "code" : kind == 0 ? "data" : "outside the statements");
+    place = text.str();
+    return true;
+}
+
+//Shows the progress of the current or last run, and where the PC is
+//in the source when the program has debug information
+bool status(const DynamicArray<string>& command){
+    runner.status();
+    string place, source;
+    if(!runner.isActive() && sourceOf(GetPC(), place, source))
+        cout << "Source:       " << place << "\n";
+    return true;
+}
+
+//where [address|symbol]
+//Shows the source statement at an address (the PC by default) of a
+//program loaded with its debug file (object.dbg).
+bool where(const DynamicArray<string>& command){
+    int address = GetPC();
+    if(command.size() == 2){
+        const string& target = command.at(1);
+        bool found = false;
+
+        //a symbol of a resident program, relocated with it
+        const unordered_map<string, Program>& resident = sessions->current().programs;
+        for(unordered_map<string, Program>::const_iterator itr = resident.begin(); itr != resident.end() && !found; itr++)
+            if(itr->second.debug && itr->second.debug->addressOf(target, address)){
+                address += itr->second.offset;
+                found = true;
+            }
+        if(!found && !Codec::parseInt(target, address, 16)){
+            cout << "Error. \"" << target << "\" is not an address or a known symbol.\n";
+            return false;
+        }
+    }
+
+    string place, source;
+    if(!sourceOf(address, place, source)){
+        cout << "No debug information for " << Codec::hexValue(address, 6) << ".\n";
+        return false;
+    }
+    cout << Codec::hexValue(address, 6) << "  " << place << "\n";
+    if(!source.empty())
+        cout << "        " << source << "\n";
+    return true;
 }
 
-void debug(const DynamicArray<string>& command){
+//Pauses a background run at an instruction boundary
+bool stop(const DynamicArray<string>& command){
+    return runner.stop();
+}
+
+//Continues a paused run. "resume &" continues in the background.
+bool resume(const DynamicArray<string>& command){
+    bool background = command.size() == 2 && command.at(1) == "&";
+    return runner.resume(background);
+}
+
+//Runs the program of every session together, sharing threads host
+//threads (default 1). A machine that polls a busy device gives up its
+//thread to another one instead of spinning.
+//  schedule [threads]
+bool schedule(const DynamicArray<string>& command){
+    if(runner.isActive()){
+        cout << "The machine is running. Use 'stop' first.\n";
+        return false;
+    }
+
+    int threads = 1;
+    if(command.size() == 2 && (!Codec::parseInt(command.at(1), threads, 10) || threads < 1)){
+        cout << "Error. The number of threads must be a positive number.\n";
+        return false;
+    }
+
+    DynamicArray<Session*> list;
+    sessions->withPrograms(list);
+    if(list.size() == 0){
+        cout << "No session has a program to execute.\n";
+        return false;
+    }
+
+    Scheduler machines;
+    for(unsigned i = 0; i < list.size(); i++){
+        int entry = 0;
+        Codec::parseInt(list.at(i)->firstAddress, entry, 16);
+        SICMACHINE* previous = SICCurrent();
+        SICSelect(list.at(i)->machine);
+        SICClearCount();
+        SICSelect(previous);
+        machines.add(list.at(i)->name, list.at(i)->machine, entry);
+    }
+
+    Timer timer;
+    scheduler = &machines;
+    machines.run(threads);
+    scheduler = NULL;
+    stats.run.add(timer.seconds());
+
+    const DynamicArray<Scheduler::Task>& tasks = machines.getTasks();
+    cout << "\nSession\tInstructions\tSlices\tYields\tState\n";
+    for(unsigned i = 0; i < tasks.size(); i++){
+        SICMACHINE* previous = SICCurrent();
+        SICSelect(tasks.at(i).machine);
+        cout << tasks.at(i).name << "\t" << SICCount() << "\t\t";
+        cout << tasks.at(i).slices << "\t" << tasks.at(i).yields << "\t";
+        cout << (tasks.at(i).state == SIC_FAULTED ? "ended" : "paused") << "\n";
+        SICSelect(previous);
+    }
+    return true;
+}
+
+//Runs the program of the current session on count CPUs that share its
+//memory, each on its own host thread (see multiprocessor.h). Memory is
+//sequentially consistent between them unless "relaxed" is given.
+//  cpus [count] [sc|relaxed]
+bool cpus(const DynamicArray<string>& command){
+    if(runner.isActive()){
+        cout << "The machine is running. Use 'stop' first.\n";
+        return false;
+    }
+
+    int count = 0;
+    if(!Codec::parseInt(command.at(1), count, 10) || count < 1 || count > 256){
+        cout << "Error. The number of CPUs must be between 1 and 256.\n";
+        return false;
+    }
+    int ordering = SIC_ORDER_SC;
+    if(command.size() == 3){
+        if(command.at(2) == "relaxed")
+            ordering = SIC_ORDER_RELAXED;
+        else if(command.at(2) != "sc"){
+            cout << "Error. The memory ordering is sc or relaxed.\n";
+            return false;
+        }
+    }
+
+    const string& firstAddress = sessions->current().firstAddress;
+    if(firstAddress.empty()){
+        cout << "No starting address supplied from the object file.\n";
+        return false;
+    }
+    int entry = 0;
+    Codec::parseInt(firstAddress, entry, 16);
+
+    Multiprocessor system(sessions->current().machine, count, ordering);
+    Timer timer;
+    multiprocessor = &system;
+    unsigned long instructions = system.run(entry);
+    multiprocessor = NULL;
+    double seconds = timer.seconds();
+    stats.run.add(seconds);
+
+    bool faulted = false;
+    SICMACHINE* previous = SICCurrent();
+    for(unsigned i = 0; i < system.size(); i++){
+        SICSelect(system.cpu(i));
+        cout << "CPU " << i << ": " << SICCount() << " instructions";
+        if(SICStopped())
+            cout << ", paused at " << Codec::hexValue(GetPC(), 6);
+        if(SICFault() != 0)
+            cout << ", fault at " << Codec::hexValue(GetPC(), 6);
+        cout << "\n";
+        faulted = faulted || SICFault() != 0;
+    }
+    SICSelect(previous);
+
+    cout << "Rate: ";
+    if(seconds > 0)
+        cout << (unsigned long)(instructions / seconds) << " instructions/sec\n";
+    else
+        cout << "-\n";
+    return !faulted;
+}
+
+//Runs an object file once for every file in a directory. Each run has
+//its own machine, which reads the file from device F1; what it writes to
+//device 05 is saved under the same name in the output directory.
+//The machines run in lockstep (see lockstep.h). With --scalar they run
+//one after the other in the engine instead, for comparison.
+//  sweep [object] [input directory] [output directory] [--scalar]
+bool sweep(const DynamicArray<string>& command){
+    bool scalar = command.size() == 5 && command.at(4) == "--scalar";
+    if(command.size() != 4 && !scalar){
+        cout << "Error. Usage: sweep [object] [input directory] [output directory] [--scalar]\n";
+        return false;
+    }
+    if(runner.isActive()){
+        cout << "The machine is running. Use 'stop' first.\n";
+        return false;
+    }
+
+    const string& inputs = command.at(2);
+    const string& outputs = command.at(3);
+    DynamicArray<string> names;
+    DIR* directory = opendir(inputs.c_str());
+    if(directory == NULL){
+        cout << "Error. Cannot read the directory \"" << inputs << "\".\n";
+        return false;
+    }
+    for(struct dirent* entry = readdir(directory); entry != NULL; entry = readdir(directory))
+        if(entry->d_type == DT_REG)
+            names.push_back(entry->d_name);
+    closedir(directory);
+    if(names.size() == 0){
+        cout << "Error. There are no input files in \"" << inputs << "\".\n";
+        return false;
+    }
+    std::sort(&names.at(0), &names.at(0) + names.size());
+
+    //one machine per input, with the program loaded and buffers for
+    //the devices. The input files are read before the run.
+    SICMACHINE* previous = SICCurrent();
+    DynamicArray<SICMACHINE*> machines;
+    DynamicArray<shared_ptr<BufferDevice> > outs;
+    DynamicArray<shared_ptr<BufferDevice> > ins;
+    Program program;
+    bool loaded = true;
+    for(unsigned i = 0; i < names.size() && loaded; i++){
+        ifstream file(inputs + "/" + names.at(i), std::ios::binary);
+        string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+        machines.push_back(SICNew());
+        ins.push_back(shared_ptr<BufferDevice>(new BufferDevice(text)));
+        outs.push_back(shared_ptr<BufferDevice>(new BufferDevice()));
+
+        SICSelect(machines.at(i));
+        program = Program();
+        loaded = Loader::load(command.at(1), -1, program);
+        SICAttach(0, ins.at(i)->handle());
+        SICAttach(4, outs.at(i)->handle());
+        stats.bytesLoaded += program.bytesLoaded;
+    }
+
+    unsigned long instructions = 0;
+    Lockstep group;
+    Timer timer;
+    if(loaded && scalar){
+        for(unsigned i = 0; i < machines.size(); i++){
+            SICSelect(machines.at(i));
+            ADDRESS entry = program.entry;
+            SICRun(&entry, FALSE);
+            instructions += SICCount();
+        }
+    }
+    else if(loaded){
+        for(unsigned i = 0; i < machines.size(); i++)
+            group.add(machines.at(i));
+        lockstep = &group;
+        instructions = group.run(program.entry);
+        lockstep = NULL;
+    }
+    double seconds = timer.seconds();
+    SICSelect(previous);
+
+    bool saved = loaded;
+    for(unsigned i = 0; i < machines.size(); i++){
+        if(loaded){
+            ofstream file(outputs + "/" + names.at(i), std::ios::binary);
+            string text = outs.at(i)->text();
+            file.write(text.data(), text.length());
+            saved = saved && file.good();
+        }
+        SICFree(machines.at(i));
+    }
+    if(!loaded)
+        return false;
+    stats.run.add(seconds);
+
+    cout << "Machines:      " << machines.size() << "\n";
+    cout << "Instructions:  " << instructions << "\n";
+    if(!scalar){
+        cout << "In lockstep:   " << group.getSteps() << " per machine\n";
+        cout << "Left lockstep: " << group.getEjected() << " machines\n";
+    }
+    cout << "Rate:          ";
+    if(seconds > 0)
+        cout << (unsigned long)(instructions / seconds) << " instructions/sec\n";
+    else
+        cout << "-\n";
+    if(!saved)
+        cout << "Error. Cannot write the outputs to \"" << outputs << "\".\n";
+    return saved;
+}
+
+//Converts a device code (F1, F2, F3, 04, 05, 06) to its index
+//in the engine (0 to 5). Returns false for other codes.
+bool deviceIndex(const string& code, int& index){
+    int value = 0;
+    if(!Codec::parseInt(code, value, 16))
+        return false;
+    index = (value > 240 ? value - 240 : value) - 1;
+    return index >= 0 && index < 6;
+}
+
+//Replaces the file behind a device of the current session.
+//  device list
+//  device [dev] file [path]               any file
+//  device [dev] buffer [text ...]         text to read, or output kept in memory
+//  device [dev] show                      the output kept by a buffer
+//  device [dev] repeat [text] [count]     reads count lines of text
+//  device [dev] pipe [session] [dev]      this output device feeds the
+//                                         input device of another session
+//  device [dev] default                   back to the default file
+bool device(const DynamicArray<string>& command){
+    if(command.size() == 2 && command.at(1) == "list"){
+        sessions->current().displayDevices();
+        return true;
+    }
+    if(command.size() < 3){
+        cout << "Error. Usage: device list | device [dev] file|buffer|show|repeat|pipe|default ...\n";
+        return false;
+    }
+    if(runner.isActive()){
+        cout << "The machine is running. Use 'stop' first.\n";
+        return false;
+    }
+
+    int index = 0;
+    if(!deviceIndex(command.at(1), index)){
+        cout << "Error. \"" << command.at(1) << "\" is not a device (F1-F3, 04-06).\n";
+        return false;
+    }
+    bool output = index > 2;
+    Session& current = sessions->current();
+    const string& kind = command.at(2);
+
+    if(kind == "default" && command.size() == 3){
+        current.attach(index, shared_ptr<Device>());
+        return true;
+    }
+    if(kind == "show" && command.size() == 3){
+        BufferDevice* buffer = dynamic_cast<BufferDevice*>(current.devices[index].get());
+        if(buffer == NULL){
+            cout << "Error. The device is not a buffer.\n";
+            return false;
+        }
+        cout << buffer->text() << endl;
+        return true;
+    }
+    if(kind == "file" && command.size() == 4){
+        shared_ptr<FileDevice> file(new FileDevice(command.at(3), output));
+        if(!file->isOpen()){
+            cout << "Error. Cannot open \"" << command.at(3) << "\".\n";
+            return false;
+        }
+        current.attach(index, file);
+        return true;
+    }
+    if(kind == "buffer"){
+        string text;
+        for(unsigned i = 3; i < command.size(); i++)
+            text += (i > 3 ? " " : "") + command.at(i);
+        if(output && !text.empty()){
+            cout << "Error. An output buffer starts empty.\n";
+            return false;
+        }
+        current.attach(index, shared_ptr<Device>(new BufferDevice(output ? "" : text + "\n")));
+        return true;
+    }
+    if(kind == "repeat" && command.size() == 5 && !output){
+        int count = 0;
+        if(!Codec::parseInt(command.at(4), count, 10)){
+            cout << "Error. Invalid count \"" << command.at(4) << "\".\n";
+            return false;
+        }
+        string line = command.at(3) + "\n";
+        long total = static_cast<long>(line.length()) * count;
+        long position = 0;
+        std::function<int()> generate = [line, total, position]() mutable -> int{
+            if(position >= total)
+                return -1;
+            return Device::fromText(line[position++ % line.length()]);
+        };
+        current.attach(index, shared_ptr<Device>(new GeneratorDevice(generate,
+                    "repeat " + command.at(3) + " " + command.at(4))));
+        return true;
+    }
+    if(kind == "pipe" && command.size() == 5 && output){
+        Session* reader = sessions->find(command.at(3));
+        int readerIndex = 0;
+        if(reader == NULL || reader == &current){
+            cout << "Error. A pipe needs another existing session.\n";
+            return false;
+        }
+        if(!deviceIndex(command.at(4), readerIndex) || readerIndex > 2){
+            cout << "Error. \"" << command.at(4) << "\" is not an input device (F1-F3).\n";
+            return false;
+        }
+        shared_ptr<Device> ring(new RingDevice(current.name + ":" + command.at(1) +
+                    " -> " + reader->name + ":" + command.at(4)));
+        current.attach(index, ring);
+        reader->attach(readerIndex, ring);
+        return true;
+    }
+
+    cout << "Error. Invalid device command for " << (output ? "an output" : "an input") << " device.\n";
+    return false;
+}
+
+bool debug(const DynamicArray<string>& command){
     cout << "'" << command.at(0) << "'" << " has not yet been implemented";
+    return false;
+}
+
+//Splits off an output redirection ("> file" or ">file") from the end
+//of the command. Returns false if the redirection has no file name.
+bool getRedirection(const DynamicArray<string>& command, unsigned& params, string& path){
+    params = command.size() - 1;
+    path = "";
+
+    const string& last = command.at(params);
+    if(params >= 2 && command.at(params-1) == ">"){
+        path = last;
+        params -= 2;
+    }
+    else if(last.length() > 1 && last.at(0) == '>'){
+        path = last.substr(1);
+        params -= 1;
+    }
+    else if(last == ">"){
+        cout << "Error. Missing file name after '>'.\n";
+        return false;
+    }
+    return true;
 }
 
 //Takes in two parameters which are two hexadecimal values
 //that specify the memory range to display the memory content.
-void dump(const DynamicArray<string>& command){
-    int startAddr = 0;
-    int endAddr = 0;
+//  dump [start] [end] [> file]      writes the range to the file instead
+//  dump --diff [snapshot] [> file]  shows the ranges changed since a dump
+//                                   that was saved to a file
+bool dump(const DynamicArray<string>& command){
+    unsigned params = 0;
+    string path;
+    if(!getRedirection(command, params, path))
+        return false;
 
-    //convert strings to int
-    bool success =
-        Util::stringToInt(command.at(1), startAddr, 16) &&
-        Util::stringToInt(command.at(2), endAddr, 16);
+    string output;
 
-    if(success){
-        if(startAddr <= endAddr){
-            int horizontalCols = 16;
+    if(params == 2 && command.at(1) == "--diff"){
+        if(!MemoryDump::diff(command.at(2), output))
+            return false;
+    }
+    else if(params == 2){
+        int startAddr = 0;
+        int endAddr = 0;
+
+        //convert strings to int
+        bool success =
+            Codec::parseInt(command.at(1), startAddr, 16) &&
+            Codec::parseInt(command.at(2), endAddr, 16);
+
+        if(!success){
+            cout << "Failed to convert specified hexadecimal parameters.\n";
+            return false;
+        }
+        if(startAddr > endAddr){
+            cout << "Error. Starting value is greater than the ending value.\n";
+            return false;
+        }
+        if(endAddr >= MSIZE){
+            cout << "Error. The ending value is past the end of memory.\n";
+            return false;
+        }
+        output = MemoryDump::dump(startAddr, endAddr);
+    }
+    else{
+        cout << "Error. Usage: dump [start] [end] [> file] | dump --diff [snapshot] [> file]\n";
+        return false;
+    }
 
-            //go through every byte
-            for(int address = startAddr; address <= endAddr; address++){
+    if(path.empty()){
+        cout << endl;
+        cout.write(output.data(), output.length());
+        return true;
+    }
 
-                //create new line at each of these intervals
-                if( (address - startAddr) % horizontalCols == 0)
-                    cout << endl;
+    ofstream file(path, std::ios::binary);
+    if(!file.is_open()){
+        cout << "Error. Cannot write to \"" << path << "\".\n";
+        return false;
+    }
+    file.write(output.data(), output.length());
+    return true;
+}
 
-                ADDRESS a = static_cast<ADDRESS>(address);
-                BYTE b = 0;
+//session new <name> | session use <name> | session list
+bool session(const DynamicArray<string>& command){
+    string action = command.at(1);
 
-                //fetch byte at the specified memory address;
-                GetMem(a, &b, 0);
+    if(action == "list" && command.size() == 2){
+        sessions->display();
+        return true;
+    }
+    if(command.size() != 3){
+        cout << "Error. Usage: session new <name> | session use <name> | session list\n";
+        return false;
+    }
 
-                //display content
-                cout << std::hex << std::setw(6) << std::setfill('0');
-                cout << address << " " << std::setw(2) << std::setfill('0');
-                cout << (int)b << "   ";
-            }
+    string name = command.at(2);
+    if(action == "new"){
+        if(sessions->create(name))
+            return true;
+        cout << "Error. Session \"" << name << "\" already exists.\n";
+    }
+    else if(action == "use"){
+        //the worker thread is running the current machine
+        if(runner.isActive()){
+            cout << "The machine is running. Use 'stop' first.\n";
+            return false;
         }
-        else cout << "Error. Starting value is greater than the ending value.\n";
+        if(sessions->use(name))
+            return true;
+        cout << "Error. Session \"" << name << "\" does not exist.\n";
     }
-    else cout << "Failed to convert specified hexadecimal parameters.\n";
+    else cout << "Error. Unknown session action \"" << action << "\".\n";
+    return false;
 }
 
-void help(const DynamicArray<string>& command){
+bool help(const DynamicArray<string>& command){
     cout << "List of available commands:\n";
-    cout << "\tload [file]\n\texecute\n\tdebug\n\tdump [start] [end]\n";
-    cout << "\thelp\n\tassemble [file]\n\tdirectory\n\texit\n";
+    cout << "\tload [file] [at address]\n\tprogram list|use [name]\n\texecute [& | --memo]\n\tstatus\n\tstop\n\tresume [&]\n\tdebug\n\tdump [start] [end] [> file]\n\tdump --diff [snapshot]\n\twhere [address|symbol]\n";
+    cout << "\tsession new|use [name]\n\tsession list\n\tschedule [threads]\n\tdevice list\n\tdevice [dev] file|buffer|show|repeat|pipe|default\n\tsweep [object] [inputs] [outputs] [--scalar]\n\tcpus [count] [sc|relaxed]\n\tstats [--json]\n\ttime [command]\n";
+    cout << "\thelp\n\tassemble [file] [--optimize] [--no-cache]\n\tassemble [file] --watch\n\tdirectory\n\texit\n";
+    return true;
 }
 
 /*The Assembler*/
-void assem(const DynamicArray<string>& command){
+string optimizationReport(const Optimizer::Report& report){
+    std::stringstream out;
+    if(!report.applied){
+        out << "Not optimized: " << report.reason << ".\n";
+        return out.str();
+    }
+    out << "Optimization report:\n";
+    out << "  Constant operands made immediate: " << report.immediates << "\n";
+    out << "  TIX limits kept in registers:     " << report.registerLimits << "\n";
+    out << "  Reloads after stores removed:     " << report.reloadsRemoved << "\n";
+    out << "  Loads added at the entry point:   " << report.entryLoads << "\n";
+    out << "  Program size: " << std::hex << report.sizeBefore << " -> " << report.sizeAfter;
+    out << std::dec << " bytes (hex)\n";
+    out << "  Saved per pass through the code: " << report.reloadsRemoved << " instructions, ";
+    out << report.immediates + report.registerLimits + report.reloadsRemoved << " memory operand reads\n";
+    return out.str();
+}
+
+//Fails if the source had errors (see the listing file).
+//"assemble [file] --optimize" rewrites SIC code into SIC/XE forms between the passes.
+//Unchanged sources are taken from the assembly cache unless --no-cache is given.
+//"assemble [file] --watch" assembles the file again whenever it is saved, until Ctrl-C.
+bool assem(const DynamicArray<string>& command){
+    bool optimize = false, useCache = true, watch = false;
+    string path = "";
+    for(unsigned i = 1; i < command.size(); i++){
+        if(command.at(i) == "--optimize")
+            optimize = true;
+        else if(command.at(i) == "--no-cache")
+            useCache = false;
+        else if(command.at(i) == "--watch")
+            watch = true;
+        else if(path.empty())
+            path = command.at(i);
+        else
+            path = "";
+    }
+    if(path.empty() || (watch && optimize)){
+        cout << "Error. Usage: assemble [file] [--optimize] [--no-cache] | assemble [file] --watch\n";
+        return false;
+    }
+
+    if(watch){
+        if(daemonServer != NULL){
+            cout << "Error. --watch is not available in the daemon.\n";
+            return false;
+        }
+        Watcher w(path);
+        watcher = &w;
+        bool watched = w.run();
+        watcher = NULL;
+        return watched;
+    }
+
+    //the key covers the source, the files it includes and the options that
+    //change the output. The debug information names the source file, so
+    //its path counts too.
+    AssemblyCache cache;
+    string source, key;
+    AssemblyCache::Result result;
+    if(useCache && AssemblyCache::readFile(path, source)){
+        key = AssemblyCache::key(source + Assembler::includedFiles(path, source),
+            string(optimize ? "optimize" : "") + '\0' + path);
+        Timer cacheTimer;
+        if(cache.fetch(key, source.length(), result)){
+            stats.cacheHits++;
+            stats.cache.add(cacheTimer.seconds());
+            cout << result.report;
+            stats.linesAssembled += result.lines;
+            stats.symbols += result.symbols;
+            stats.recordsWritten += result.records;
+            return true;
+        }
+        stats.cacheMisses++;
+    }
+
     Assembler assem;
-    assem.pass1(command.at(1));     //pass in the assembly source file path
+
+    Timer pass1Timer;
+    assem.pass1(path);     //pass in the assembly source file path
+    stats.pass1.add(pass1Timer.seconds());
+
+    if(optimize){
+        result.report = optimizationReport(assem.optimize());
+        cout << result.report;
+    }
+
+    Timer pass2Timer;
     assem.pass2();
+    stats.pass2.add(pass2Timer.seconds());
+
+    result.lines = assem.getLinesAssembled();
+    result.symbols = assem.getSymbolCount();
+    result.records = assem.getRecordsWritten();
+    stats.linesAssembled += result.lines;
+    stats.symbols += result.symbols;
+    stats.recordsWritten += result.records;
+
+    //only programs without errors are kept, the others have no object file
+    if(!key.empty() && !assem.hasErrors())
+        cache.store(key, source.length(), result);
+    return !assem.hasErrors();
+}
+
+//Shows the cumulative counters and stage timings.
+//"stats --json" prints them as one JSON object.
+bool showStats(const DynamicArray<string>& command){
+    bool json = command.size() == 2 && command.at(1) == "--json";
+    if(command.size() == 2 && !json){
+        cout << "Error. Usage: stats [--json]\n";
+        return false;
+    }
+    stats.display(json);
+    return true;
 }
 
-void dir(const DynamicArray<string>& command){
-    system("ls");
+bool dir(const DynamicArray<string>& command){
+    return system("ls") == 0;
 }
 
 //Creates the commands for the interpreter.
 void loadCommands(Interpreter& i){
-    i.addCommand("load",    1, 1, &load);
-    i.addCommand("execute", 0, 3, &exec);
+    i.addCommand("load",    1, 3, 1, &load);
+    i.addCommand("program", 1, 2, 1, &programs);
+    i.addCommand("execute", 0, 1, 3, &exec);
+    i.addCommand("status",  0, 3, &status);
+    i.addCommand("stop",    0, 3, &stop);
+    i.addCommand("resume",  0, 1, 1, &resume);
+    i.addCommand("session", 1, 2, 3, &session);
+    i.addCommand("schedule", 0, 1, 5, &schedule);
+    i.addCommand("device",  1, 32, 3, &device);
+    i.addCommand("sweep",   3, 4, 2, &sweep);
+    i.addCommand("cpus",    1, 2, 2, &cpus);
+    i.addCommand("stats",   0, 1, 5, &showStats);
     i.addCommand("debug",   0, 2, &debug);
-    i.addCommand("dump",    2, 2, &dump);
+    i.addCommand("dump",    2, 4, 2, &dump);
+    i.addCommand("where",   0, 1, 2, &where);
     i.addCommand("help",    0, 1, &help);
-    i.addCommand("assemble",  1, 1, &assem);
+    i.addCommand("assemble",  1, 3, 1, &assem);
     i.addCommand("directory", 0, 2, &dir);
 }
 
-int main(){
+/*The daemon*/
+//the commands, shared by the threads serving clients
+Interpreter* interpreter = NULL;
+
+//held by a connection while it runs commands that touch files, and by
+//its background runs: the assembler, the loader, the devices, the run
+//cache and the dumps all use the working directory of the daemon,
+//which the clients share (see filelock.h)
+FileLock daemonFiles;
+
+//the commands that leave the working directory alone
+const char* const fileFreeCommands[] = {"status", "where", "stop", "session", "help",
+                                        "stats", "debug", "program", "directory", NULL};
+
+//the machine a thread of the daemon selects between clients
+thread_local SICMACHINE* idleMachine = NULL;
+
+//Gives a new client a fresh machine in a session table of its own
+void clientConnected(){
+    if(idleMachine == NULL)
+        idleMachine = SICNew();
+    SICSelect(SICNew());
+    sessions = new SessionTable();
+    stats = Stats();
+    runner.shareFiles(&daemonFiles);
+    runner.keepOutput();
+    runner.reset();
+}
+
+//Frees the machines of a client that left
+void clientDisconnected(){
+    runner.reset();
+    SICMACHINE* machine = sessions->find("main")->machine;
+    SICSelect(idleMachine);
+    delete sessions;
+    sessions = NULL;
+    SICFree(machine);
+}
+
+//Runs the commands of a request. A request with a command that is not
+//known to leave the files alone holds them while it runs.
+int clientRequest(const string& commands, bool keepGoing){
+    bool files = false;
+    DynamicArray<string> lines;
+    Util::parseLine(lines, commands, ";\n");
+    for(unsigned i = 0; i < lines.size() && !files; i++){
+        DynamicArray<string> words;
+        Util::parseLine(words, lines.at(i), "\t ");
+        unsigned first = words.size() > 1 && words.at(0) == "time" ? 1 : 0;
+        if(words.size() <= first)
+            continue;
+        files = true;
+        for(const char* const* name = fileFreeCommands; *name != NULL && files; name++)
+            files = !Util::isPrefix(words.at(first), *name);
+    }
+
+    //a background run that ended since the last request has its
+    //output printed as it is joined
+    runner.isActive();
+
+    if(files)
+        daemonFiles.lock(&runner);
+    int exitStatus = interpreter->runCommands(commands, keepGoing);
+    if(files)
+        daemonFiles.unlock();
+    return exitStatus;
+}
+
+//sicasm --connect: sends the commands to the daemon at socketPath, or
+//the lines typed at the prompt when there are none
+int runClient(const string& socketPath, const string& commands, bool keepGoing){
+    int connection = Daemon::connectTo(socketPath);
+    if(connection < 0){
+        cout << "Error. No daemon is listening at " << socketPath << ".\n";
+        return 2;
+    }
+
+    string output;
+    int exitStatus = 0;
+    if(!commands.empty()){
+        exitStatus = Daemon::call(connection, commands, keepGoing, output);
+        cout << output;
+    }
+    else{
+        while(exitStatus >= 0){
+            cout << "\ncommand >>> ";
+            string line;
+            if(!getline(cin, line))
+                break;
+            DynamicArray<string> words;
+            Util::parseLine(words, line, "\t ");
+            if(words.size() > 0 && Util::isPrefix(words.at(0), "exit") && words.at(0).length() > 2)
+                break;
+            exitStatus = Daemon::call(connection, line, true, output);
+            cout << output;
+        }
+        exitStatus = exitStatus < 0 ? exitStatus : 0;
+    }
+    close(connection);
+
+    if(exitStatus < 0){
+        cout << "Error. The connection to the daemon was lost.\n";
+        return 2;
+    }
+    return exitStatus;
+}
+
+void usage(){
+    cout << "usage: sicasm [-k] [-c \"cmd1; cmd2; ...\" | --script file]\n";
+    cout << "       sicasm --daemon socket [--threads n]\n";
+    cout << "       sicasm --connect socket [-k] [-c \"cmd1; cmd2; ...\" | --script file]\n";
+}
+
+int main(int argc, char* argv[]){
+    //command line options
+    bool keepGoing = false;
+    string commands = "";
+    string scriptPath = "";
+    bool commandsGiven = false;
+    string daemonPath = "";
+    string connectPath = "";
+    int threads = 4;
+
+    for(int arg = 1; arg < argc; arg++){
+        string option = argv[arg];
+
+        if(option == "-k" || option == "--keep-going")
+            keepGoing = true;
+        else if(option == "--daemon" && arg+1 < argc)
+            daemonPath = argv[++arg];
+        else if(option == "--connect" && arg+1 < argc)
+            connectPath = argv[++arg];
+        else if(option == "--threads" && arg+1 < argc && Codec::parseInt(argv[arg+1], threads, 10) && threads > 0)
+            arg++;
+        else if(option == "-c" && arg+1 < argc){
+            commands = argv[++arg];
+            commandsGiven = true;
+        }
+        else if(option == "--script" && arg+1 < argc)
+            scriptPath = argv[++arg];
+        else{
+            usage();
+            return 2;
+        }
+    }
+
+    if(!daemonPath.empty() && (!connectPath.empty() || commandsGiven || !scriptPath.empty())){
+        usage();
+        return 2;
+    }
+
+    //the commands are run by the daemon
+    if(!connectPath.empty()){
+        if(!scriptPath.empty()){
+            ifstream script(scriptPath);
+            if(!script.is_open()){
+                cout << "Error. \"" << scriptPath << "\" script file was not found.\n";
+                return 2;
+            }
+            commands.assign((std::istreambuf_iterator<char>(script)), std::istreambuf_iterator<char>());
+        }
+        return runClient(connectPath, commands, keepGoing);
+    }
+
     //initialize the SIC simulator
     SICInit();
+    SICPrinter(&print);
+    Services::install();
+    signal(SIGINT, interrupt);
+
+    SessionTable table;
+    sessions = &table;
 
     //Create command line interpreter for the SIC
     Interpreter i;
     loadCommands(i);
+
+    if(!daemonPath.empty()){
+        //"directory" lists the daemon's directory on its own output
+        i.removeCommand("directory");
+        interpreter = &i;
+
+        Daemon::Handlers handlers;
+        handlers.connected = &clientConnected;
+        handlers.request = &clientRequest;
+        handlers.disconnected = &clientDisconnected;
+        handlers.stopping = &SICStopAll;
+        Daemon server(daemonPath, threads, handlers);
+        daemonServer = &server;
+        bool served = server.run();
+        daemonServer = NULL;
+        return served ? 0 : 1;
+    }
+
+    if(commandsGiven)
+        return i.runCommands(commands, keepGoing);
+
+    if(!scriptPath.empty()){
+        ifstream script(scriptPath);
+        if(!script.is_open()){
+            cout << "Error. \"" << scriptPath << "\" script file was not found.\n";
+            return 2;
+        }
+        return i.runScript(script, keepGoing);
+    }
+
     i.run();
 
     return 0;
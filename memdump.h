@@ -0,0 +1,154 @@
+
+/*
+    Memory dumps and snapshot diffs for the "dump" command.
+
+    Memory is read in bulk and formatted into a single buffer,
+    16 bytes per line:
+        001000 14 10 33 48 20 39 00 10 36 28 10 30 30 10 15 48
+
+    A dump written to a file can be used later as a snapshot.
+    diff() compares the current memory against a snapshot and only
+    reports the ranges that changed.
+*/
+
+#ifndef MEMDUMP_H
+#define MEMDUMP_H
+
+#include <fstream>
+#include <cstring>
+#include "codec.h"
+#include "util.h"
+
+extern "C"{
+    #include "sicengine.h"
+}
+
+using std::ifstream;
+
+class MemoryDump{
+
+    private:
+        static const int bytesPerLine = 16;
+        static const int addressDigits = 6;
+
+        //address + one space and two digits per byte + newline
+        static const int lineLength = addressDigits + 3*bytesPerLine + 1;
+
+    public:
+        //Formats len bytes that start at address into lines
+        //and appends them to out.
+        static void format(string& out, ADDRESS address, const BYTE* bytes, long len){
+            size_t pos = out.length();
+            long lines = (len + bytesPerLine - 1) / bytesPerLine;
+            out.resize(pos + lines * lineLength);
+            char* dst = &out[pos];
+
+            for(long i = 0; i < len; i += bytesPerLine){
+                Codec::hexValue(address + i, addressDigits, dst);
+                dst += addressDigits;
+
+                long end = i + bytesPerLine < len ? i + bytesPerLine : len;
+                for(long j = i; j < end; j++){
+                    *dst++ = ' ';
+                    Codec::hexByte(bytes[j], dst);
+                    dst += 2;
+                }
+                *dst++ = '\n';
+            }
+            //the last line may be short
+            out.resize(dst - out.data());
+        }
+
+        //Reads memory from start to end (inclusive) and formats it
+        static string dump(ADDRESS start, ADDRESS end){
+            long len = end - start + 1;
+            BYTE* bytes = new BYTE[len];
+            GetMemBlock(start, bytes, len);
+
+            string out;
+            out.reserve((len / bytesPerLine + 1) * lineLength);
+            format(out, start, bytes, len);
+
+            delete[] bytes;
+            return out;
+        }
+
+        //Loads a snapshot written by dump into image (MSIZE bytes).
+        //known[a] is set for every address the snapshot covers.
+        //Returns false if the file cannot be read or is malformed.
+        static bool loadSnapshot(const string& path, BYTE* image, bool* known){
+            ifstream snapshot(path);
+            if(!snapshot.is_open()){
+                cout << "Error. \"" << path << "\" snapshot file was not found.\n";
+                return false;
+            }
+
+            std::memset(known, 0, MSIZE * sizeof(bool));
+            string line;
+            while(getline(snapshot, line)){
+                if(line.empty())
+                    continue;
+
+                int address = 0;
+                if(line.length() < addressDigits ||
+                        !Codec::parseInt(line.data(), addressDigits, address, 16)){
+                    cout << "Error. Invalid snapshot line: " << line << "\n";
+                    return false;
+                }
+
+                //every byte is " XX"
+                for(size_t i = addressDigits; i + 3 <= line.length(); i += 3, address++){
+                    if(line[i] != ' ' || address >= MSIZE ||
+                            !Codec::hexDecode(line.data() + i + 1, 2, &image[address])){
+                        cout << "Error. Invalid snapshot line: " << line << "\n";
+                        return false;
+                    }
+                    known[address] = true;
+                }
+            }
+            return true;
+        }
+
+        //Reports the ranges of memory that differ from the snapshot.
+        //Every range is a header line followed by its current contents.
+        static bool diff(const string& path, string& out){
+            BYTE* image = new BYTE[MSIZE];
+            BYTE* memory = new BYTE[MSIZE];
+            bool* known = new bool[MSIZE];
+
+            bool loaded = loadSnapshot(path, image, known);
+            if(loaded){
+                GetMemBlock(0, memory, MSIZE);
+
+                long changed = 0;
+                long a = 0;
+                while(a < MSIZE){
+                    //skip equal bytes
+                    if(!known[a] || image[a] == memory[a]){
+                        a++;
+                        continue;
+                    }
+
+                    //extend the range while bytes differ
+                    long start = a;
+                    while(a < MSIZE && known[a] && image[a] != memory[a])
+                        a++;
+
+                    out += Codec::hexValue(start, addressDigits) + "-";
+                    out += Codec::hexValue(a - 1, addressDigits) + " changed\n";
+                    format(out, start, memory + start, a - start);
+                    changed += a - start;
+                }
+
+                if(changed == 0)
+                    out += "No changes since the snapshot.\n";
+            }
+
+            delete[] image;
+            delete[] memory;
+            delete[] known;
+            return loaded;
+        }
+};
+
+#endif
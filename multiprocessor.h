@@ -0,0 +1,126 @@
+
+/*
+    A multiprocessor SIC: several CPUs that share the memory of one machine.
+
+    CPU 0 is the machine itself, the others are created with SICNewShared
+    and have their own registers, status word and devices. Every CPU runs
+    on its own host thread, all of them starting at the same address with
+    their CPU number in register A, so a program can tell them apart.
+
+    Memory is sequentially consistent between the CPUs unless the relaxed
+    ordering is chosen: each instruction runs as a whole, under a lock on
+    the memory. With the relaxed ordering only single bytes are accessed
+    as a unit, so another CPU can see a word half written, and a program
+    guards its shared words with a lock. The instruction TS sets a byte
+    to X'FF' atomically and reports its old value in CC ('=' if it was
+    0), for locks:
+        LOCK    TS      FLAG
+                JGT     LOCK
+                ...               critical section
+                LDCH    ZERO
+                STCH    FLAG      release
+*/
+
+#ifndef MULTIPROCESSOR_H
+#define MULTIPROCESSOR_H
+
+#include <thread>
+#include "dynamic_array.h"
+#include "util.h"
+
+extern "C"{
+    #include "sicengine.h"
+}
+
+class Multiprocessor{
+
+    private:
+        //cpus.at(0) is the machine that owns the memory
+        DynamicArray<SICMACHINE*> cpus;
+
+        static void work(SICMACHINE* cpu, ADDRESS entry){
+            SICSelect(cpu);
+            SICRun(&entry, FALSE);
+        }
+
+        Multiprocessor(const Multiprocessor&);
+        Multiprocessor& operator=(const Multiprocessor&);
+
+    public:
+        Multiprocessor(SICMACHINE* machine, unsigned count, int ordering){
+            cpus.push_back(machine);
+            for(unsigned i = 1; i < count; i++)
+                cpus.push_back(SICNewShared(machine));
+
+            //the owner shares its memory for as long as the others exist
+            SICMACHINE* previous = SICCurrent();
+            for(unsigned i = 0; i < cpus.size(); i++){
+                SICSelect(cpus.at(i));
+                SICOrdering(ordering);
+            }
+            SICSelect(machine);
+            SICSharing(count > 1);
+            SICSelect(previous);
+        }
+
+        //the machine that owns the memory is not freed, it runs alone again
+        ~Multiprocessor(){
+            for(unsigned i = 1; i < cpus.size(); i++)
+                SICFree(cpus.at(i));
+            SICMACHINE* previous = SICCurrent();
+            SICSelect(cpus.at(0));
+            SICSharing(FALSE);
+            SICSelect(previous);
+        }
+
+        //Runs every CPU from entry until all of them have stopped.
+        //Returns the number of instructions they executed.
+        unsigned long run(ADDRESS entry){
+            SICMACHINE* previous = SICCurrent();
+            for(unsigned i = 0; i < cpus.size(); i++){
+                SICSelect(cpus.at(i));
+                SICClearCount();
+
+                //A holds the CPU number, the other registers X'FFFFFF'
+                //so that RSUB from the program ends it
+                WORD registers[6];
+                for(int r = 0; r < 6; r++)
+                    registers[r][0] = registers[r][1] = registers[r][2] = 0xFF;
+                registers[0][0] = 0;
+                registers[0][1] = (i >> 8) & 0xFF;
+                registers[0][2] = i & 0xFF;
+                PutReg(registers);
+            }
+            SICSelect(previous);
+
+            DynamicArray<std::thread> threads;
+            for(unsigned i = 0; i < cpus.size(); i++)
+                threads.emplace_back(work, cpus.at(i), entry);
+            for(unsigned i = 0; i < threads.size(); i++)
+                threads.at(i).join();
+
+            unsigned long total = 0;
+            for(unsigned i = 0; i < cpus.size(); i++){
+                SICSelect(cpus.at(i));
+                total += SICCount();
+            }
+            SICSelect(previous);
+            return total;
+        }
+
+        //Pauses every CPU. Safe to call from a signal handler.
+        void stop(){
+            for(unsigned i = 0; i < cpus.size(); i++)
+                SICStopMachine(cpus.at(i));
+        }
+
+        unsigned size() const{
+            return cpus.size();
+        }
+
+        SICMACHINE* cpu(unsigned i) const{
+            return cpus.at(i);
+        }
+};
+
+#endif
@@ -0,0 +1,377 @@
+
+/*
+    An optional pass between pass 1 and pass 2 of the assembler that
+    rewrites plain SIC code into cheaper SIC/XE forms.
+
+    It reads the intermediate file into one Line per instruction or
+    directive, rewrites the lines, lays the program out again (addresses
+    and the symbol table) and writes the intermediate file back for
+    pass 2. The rewrites are:
+        constants      LDA ONE  ->  LDA #1, when ONE is a WORD (or a one
+                       byte BYTE for LDCH) that nothing stores into and
+                       whose value fits in 12 bits
+        loop limits    TIX LEN  ->  TIXR T, with LEN loaded into T once at
+                       the entry point. Only registers the program never
+                       uses (T, S, B) are taken.
+        reloads        STA X / LDA X  ->  STA X, for the same register
+                       when nothing can jump to the load
+
+    Moving code is only safe when the program does not depend on where
+    its code and data are, so the pass leaves programs alone that use
+    absolute (numeric) operands, SIO or SVC (which write memory at
+    computed addresses) or store into their own instructions. Addresses
+    kept as numbers in WORD constants cannot be seen and must not be
+    used with this pass.
+*/
+
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+#include "dynamic_array.h"
+#include "util.h"
+#include "codec.h"
+
+using std::ifstream;
+using std::ofstream;
+using std::unordered_map;
+using std::unordered_set;
+
+class Optimizer{
+
+    public:
+        //a block of the intermediate file, with the source columns split out
+        struct Line{
+            string source;
+            string opcode;      //hex opcode, or the directive
+            int address;
+            string operand;
+            string errors;
+
+            string label;
+            string mnemonic;
+            string symbol;      //operand without ",X"
+            bool indexed;
+            int size;           //bytes
+            int line;           //in the source file
+
+            Line() : address(0), indexed(false), size(0), line(0){}
+        };
+
+        //what was rewritten, for the report
+        struct Report{
+            bool applied;
+            string reason;      //why the pass was skipped
+            unsigned immediates;
+            unsigned registerLimits;
+            unsigned reloadsRemoved;
+            unsigned entryLoads;
+            int sizeBefore;
+            int sizeAfter;
+
+            Report() : applied(false), immediates(0), registerLimits(0),
+                reloadsRemoved(0), entryLoads(0), sizeBefore(0), sizeAfter(0){}
+        };
+
+    private:
+        DynamicArray<Line> lines;
+        Report report;
+
+        //symbols whose memory the program may change
+        unordered_set<string> written;
+
+        //symbols of read-only constants and their value as a word
+        //and as the first byte (what LDCH reads)
+        unordered_map<string, long> words;
+        unordered_map<string, long> bytes;
+
+        static bool isStore(const string& m){
+            return m == "STA" || m == "STX" || m == "STL" || m == "STCH" || m == "STS"
+                || m == "STT" || m == "STB" || m == "STF" || m == "TS";
+        }
+
+        static bool isData(const string& m){
+            return m == "WORD" || m == "BYTE" || m == "RESW" || m == "RESB" || m == "INCBIN" || m == "FILL";
+        }
+
+        //the load that reads back what store wrote, "" if none
+        static string reloadOf(const string& store){
+            if(store == "STA")  return "LDA";
+            if(store == "STX")  return "LDX";
+            if(store == "STL")  return "LDL";
+            if(store == "STCH") return "LDCH";
+            if(store == "STS")  return "LDS";
+            if(store == "STT")  return "LDT";
+            if(store == "STB")  return "LDB";
+            return "";
+        }
+
+        //instructions that take a word operand as an immediate just the same
+        static bool takesImmediate(const string& m){
+            return m == "LDA" || m == "LDX" || m == "LDL" || m == "LDS" || m == "LDT"
+                || m == "LDB" || m == "ADD" || m == "SUB" || m == "MUL" || m == "DIV"
+                || m == "COMP" || m == "AND" || m == "OR" || m == "TIX";
+        }
+
+        static string hex(int value){
+            std::stringstream s;
+            s << std::hex << value;
+            return s.str();
+        }
+
+        static string format(const string& label, const string& mnemonic, const string& operand){
+            string text = label;
+            text.resize(8, ' ');
+            text += mnemonic;
+            text.resize(16, ' ');
+            return text + operand;
+        }
+
+        bool load(const string& path, const DynamicArray<int>& sourceLines){
+            ifstream intermediate(path);
+            if(!intermediate.is_open())
+                return false;
+
+            Line line;
+            string address;
+            while(getline(intermediate, line.source)){
+                getline(intermediate, line.opcode);
+                getline(intermediate, address);
+                getline(intermediate, line.operand);
+                getline(intermediate, line.errors);
+
+                line.address = 0;
+                Codec::parseInt(address, line.address, 16);
+
+                DynamicArray<string> columns;
+                Util::parseLine(columns, line.source, "\t ");
+                if(line.source.empty() || line.source[0] == ' ' || line.source[0] == '\t')
+                    columns.push_front("");
+                columns.resize(3, "");
+                line.label = columns.at(0);
+                line.mnemonic = columns.at(1);
+
+                line.indexed = line.operand.length() > 2 &&
+                    line.operand.compare(line.operand.length() - 2, 2, ",X") == 0;
+                line.symbol = line.indexed ? line.operand.substr(0, line.operand.length() - 2) : line.operand;
+                line.line = lines.size() < sourceLines.size() ? sourceLines.at(lines.size()) : 0;
+                lines.push_back(line);
+            }
+
+            //sizes from the layout of pass 1
+            for(unsigned i = 0; i + 1 < lines.size(); i++)
+                lines.at(i).size = lines.at(i + 1).address - lines.at(i).address;
+            return lines.size() >= 2 && lines.at(0).opcode == "START"
+                && lines.at(lines.size() - 1).opcode == "END";
+        }
+
+        //Returns "" if the program can be rearranged, otherwise why not
+        string check(){
+            unordered_set<string> code;
+            for(unsigned i = 0; i < lines.size(); i++){
+                const Line& line = lines.at(i);
+                if(!line.errors.empty())
+                    return "the source has errors";
+                if(line.mnemonic == "SIO" || line.mnemonic == "SVC")
+                    return line.mnemonic + " writes memory at computed addresses";
+                if(!isData(line.mnemonic) && line.opcode != "START" && !line.symbol.empty()
+                        && Util::isDigit(line.symbol[0]) && line.opcode != "END")
+                    return "absolute operand " + line.operand;
+                if(isStore(line.mnemonic))
+                    written.insert(line.symbol);
+                if(!line.label.empty() && !isData(line.mnemonic))
+                    code.insert(line.label);
+            }
+            for(const string& symbol : written)
+                if(code.count(symbol) != 0)
+                    return "the program stores into its code at " + symbol;
+            return "";
+        }
+
+        void findConstants(){
+            for(unsigned i = 0; i < lines.size(); i++){
+                const Line& line = lines.at(i);
+                if(line.label.empty() || written.count(line.label) != 0)
+                    continue;
+
+                int value = 0;
+                if(line.mnemonic == "WORD" && Codec::parseInt(line.operand, value, 10) && value >= 0){
+                    words[line.label] = value;
+                    bytes[line.label] = (value >> 16) & 0xFF;
+                }
+                else if(line.mnemonic == "BYTE" && line.operand.length() >= 4){
+                    if(line.operand[0] == 'C')
+                        bytes[line.label] = static_cast<unsigned char>(line.operand[2]);
+                    else if(line.operand[0] == 'X' && Codec::parseInt(line.operand.substr(2, 2), value, 16))
+                        bytes[line.label] = value;
+                }
+            }
+        }
+
+        //registers the program never names
+        DynamicArray<string> freeRegisters(){
+            bool used[3] = {false, false, false};
+            const char* names[3] = {"T", "S", "B"};
+            for(unsigned i = 0; i < lines.size(); i++){
+                const string& m = lines.at(i).mnemonic;
+                if(m == "LDT" || m == "STT") used[0] = true;
+                if(m == "LDS" || m == "STS") used[1] = true;
+                if(m == "LDB" || m == "STB") used[2] = true;
+            }
+            DynamicArray<string> available;
+            for(int r = 0; r < 3; r++)
+                if(!used[r])
+                    available.push_back(names[r]);
+            return available;
+        }
+
+        void rewrite(const unordered_map<string, unsigned>& opcodes){
+            //the limits are loaded ahead of the first line, which must be code
+            DynamicArray<string> available;
+            if(!isData(lines.at(1).mnemonic) && lines.at(1).opcode != "END")
+                available = freeRegisters();
+
+            //the limit symbol each register holds
+            unordered_map<string, string> limits;
+            DynamicArray<string> limitOrder;
+
+            DynamicArray<Line> out;
+            for(unsigned i = 0; i < lines.size(); i++){
+                Line line = lines.at(i);
+                const string& m = line.mnemonic;
+                bool plain = !line.indexed && !line.symbol.empty();
+
+                //STx X / LDx X
+                if(plain && line.label.empty() && out.size() > 0){
+                    const Line& previous = out.at(out.size() - 1);
+                    if(!previous.indexed && previous.symbol == line.symbol && reloadOf(previous.mnemonic) == m){
+                        report.reloadsRemoved++;
+                        continue;
+                    }
+                }
+
+                //TIX LEN -> TIXR r
+                if(plain && m == "TIX" && words.count(line.symbol) != 0){
+                    if(limits.count(line.symbol) == 0 && limitOrder.size() < available.size()){
+                        limits[line.symbol] = available.at(limitOrder.size());
+                        limitOrder.push_back(line.symbol);
+                    }
+                    if(limits.count(line.symbol) != 0){
+                        line.mnemonic = "TIXR";
+                        line.opcode = hex(0xB8);
+                        line.operand = line.symbol = limits[line.symbol];
+                        line.size = 2;
+                        line.source = format(line.label, line.mnemonic, line.operand);
+                        report.registerLimits++;
+                        out.push_back(line);
+                        continue;
+                    }
+                }
+
+                //OP CONST -> OP #value
+                long value = -1;
+                if(plain && takesImmediate(m) && words.count(line.symbol) != 0)
+                    value = words[line.symbol];
+                else if(plain && m == "LDCH" && bytes.count(line.symbol) != 0)
+                    value = bytes[line.symbol];
+                if(value >= 0 && value < 4096){
+                    line.operand = "#" + std::to_string(value);
+                    line.source = format(line.label, line.mnemonic, line.operand);
+                    report.immediates++;
+                }
+                out.push_back(line);
+            }
+
+            //load the limits where execution starts (the loader always
+            //starts at the first instruction), which takes over its label
+            if(!limitOrder.empty()){
+                unsigned at = 1;
+                DynamicArray<Line> withLoads;
+                for(unsigned i = 0; i < out.size(); i++){
+                    if(i == at){
+                        Line& first = out.at(i);
+                        for(unsigned r = 0; r < limitOrder.size(); r++){
+                            Line load;
+                            load.label = r == 0 ? first.label : "";
+                            load.mnemonic = "LD" + limits[limitOrder.at(r)];
+                            load.opcode = hex(opcodes.at(load.mnemonic));
+                            load.operand = load.symbol = limitOrder.at(r);
+                            load.size = 3;
+                            load.line = first.line;
+                            long limit = words[load.symbol];
+                            if(limit < 4096)
+                                load.operand = "#" + std::to_string(limit);
+                            load.source = format(load.label, load.mnemonic, load.operand);
+                            withLoads.push_back(load);
+                            report.entryLoads++;
+                        }
+                        first.label = "";
+                        first.source = format("", first.mnemonic, first.operand);
+                    }
+                    withLoads.push_back(out.at(i));
+                }
+                out = withLoads;
+            }
+            lines = out;
+        }
+
+        //addresses and symbols for the new layout
+        void layout(unordered_map<string, unsigned>& symbols, int& programLength){
+            int start = lines.at(0).address;
+            int locctr = start;
+            symbols.clear();
+            for(unsigned i = 0; i < lines.size(); i++){
+                Line& line = lines.at(i);
+                line.address = locctr;
+                if(!line.label.empty() && line.opcode != "START")
+                    symbols.insert(std::make_pair(line.label, locctr));
+                if(line.opcode != "START" && line.opcode != "END")
+                    locctr += line.size;
+            }
+            programLength = locctr - start;
+        }
+
+        void save(const string& path){
+            ofstream intermediate(path);
+            for(unsigned i = 0; i < lines.size(); i++){
+                const Line& line = lines.at(i);
+                intermediate << line.source << "\n" << line.opcode << "\n";
+                intermediate << std::hex << line.address << std::dec << "\n";
+                intermediate << line.operand << "\n" << line.errors << "\n";
+            }
+        }
+
+    public:
+        //Rewrites the intermediate file at path. symbols, programLength and
+        //sourceLines (the source line of each block) are replaced by those
+        //of the new layout.
+        Report run(const string& path, const unordered_map<string, unsigned>& opcodes,
+                unordered_map<string, unsigned>& symbols, int& programLength, DynamicArray<int>& sourceLines){
+            if(!load(path, sourceLines)){
+                report.reason = "the program has no START or END";
+                return report;
+            }
+            report.reason = check();
+            if(!report.reason.empty())
+                return report;
+
+            report.sizeBefore = programLength;
+            findConstants();
+            rewrite(opcodes);
+            layout(symbols, programLength);
+            save(path);
+
+            sourceLines.clear();
+            for(unsigned i = 0; i < lines.size(); i++)
+                sourceLines.push_back(lines.at(i).line);
+
+            report.sizeAfter = programLength;
+            report.applied = true;
+            return report;
+        }
+};
+
+#endif
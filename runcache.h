@@ -0,0 +1,358 @@
+
+/*
+    A persistent cache of program runs, for "execute --memo".
+
+    The key of a run is a hash of everything the run can depend on:
+        - the memory image
+        - the registers and the PC it starts at
+        - the rest of the machine state (SICGetState)
+        - the bytes of the input device files
+    An entry holds what the run changed:
+        - the bytes of memory
+        - the registers and the state
+        - the instruction count and the fault
+        - what it wrote to each output device
+    When a run has a known key, it is replayed from its entry instead of
+    executed.
+
+    Only runs that depend on nothing else are kept. The cache does not
+    engage when a device has a backend attached. Generators and pipes
+    depend on the host or on another machine, and the position of a
+    buffer is not part of the machine. It also does not engage while a
+    channel has a program. A run is not stored if it called a host
+    service with SVC, used the counter device (07), whose readings
+    hold the host time, or was paused.
+
+    Each entry is one file <key>.run in the cache directory of the
+    assembler, under the same size cap (see cache.h):
+        SICASM-RUN <version> <input length>
+        <PC> <instructions>
+        state <length>                  then the state (encode)
+        registers <length>              then the registers
+        memory <start> <length>         then the bytes, for each changed range
+        output <device> <from> <length> then the bytes written, for each
+                                        output device; from is -1 if the
+                                        run created the file
+        end
+*/
+
+#ifndef RUNCACHE_H
+#define RUNCACHE_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "cache.h"
+#include "dynamic_array.h"
+#include "util.h"
+
+extern "C"{
+    #include "sicengine.h"
+}
+
+class RunCache{
+
+    public:
+        enum Outcome{
+            replayed,       //taken from the cache, not executed
+            stored,         //executed and kept
+            executed        //executed without the cache, see reason()
+        };
+
+    private:
+        //changes whenever the engine can run the same input differently
+        static const int version = 3;
+
+        //changed bytes closer than this are kept in one range
+        static const long gap = 8;
+
+        string directory;
+        off_t capacity;         //bytes, shared with the assembly cache
+
+        Outcome last;
+        string why;
+
+        static const char* file(int device){
+            static const char* const names[6] = {"devf1", "devf2", "devf3", "dev04", "dev05", "dev06"};
+            return names[device];
+        }
+
+        string path(const string& key) const{
+            return directory + "/" + key + ".run";
+        }
+
+        //The state as text, the same for the same state
+        static string encode(const SICSTATE& state){
+            char text[96];
+            snprintf(text, sizeof text, "%02x%02x%02x %a %d %lu %d %d", state.SW[0], state.SW[1],
+                state.SW[2], state.F, state.Fault, state.Clock, state.Attached, state.Channels);
+            string out = text;
+            for(int i = 0; i < 6; i++){
+                snprintf(text, sizeof text, " %ld %d %d %d", state.Position[i], state.AtEnd[i],
+                    state.EndRead[i], state.Countdown[i]);
+                out += text;
+            }
+            return out;
+        }
+
+        static bool decode(const string& text, SICSTATE& state){
+            std::istringstream in(text);
+            string status, f;
+            int attached = 0, channels = 0;
+            in >> status >> f >> state.Fault >> state.Clock >> attached >> channels;
+            int word = 0;
+            if(!in || !Codec::parseInt(status, word, 16))
+                return false;
+            state.SW[0] = (word >> 16) & 0xFF;
+            state.SW[1] = (word >> 8) & 0xFF;
+            state.SW[2] = word & 0xFF;
+            state.F = strtod(f.c_str(), NULL);
+            state.Attached = attached;
+            state.Channels = channels;
+            for(int i = 0; i < 6; i++){
+                int atEnd = 0, endFile = 0, wait = 0;
+                in >> state.Position[i] >> atEnd >> endFile >> wait;
+                state.AtEnd[i] = atEnd;
+                state.EndRead[i] = endFile;
+                state.Countdown[i] = wait;
+            }
+            return !in.fail();
+        }
+
+        //The bytes that decide a run from address
+        static string inputOf(ADDRESS address, const SICSTATE& state){
+            string input(reinterpret_cast<const char*>(SICMemory()), MSIZE);
+            input.append(reinterpret_cast<const char*>(SICRegisters()), sizeof(WORD) * 6);
+            input += Codec::hexValue(address, 6) + " " + encode(state) + "\n";
+            for(int i = 0; i < 3; i++){
+                string bytes;
+                if(AssemblyCache::readFile(file(i), bytes))
+                    input += std::to_string(bytes.length()) + "\n" + bytes;
+                else
+                    input += "-\n";
+            }
+            return input;
+        }
+
+        //Reads length bytes of a file from offset
+        static bool readPart(const char* name, long offset, long length, string& bytes){
+            std::ifstream in(name, std::ios::binary);
+            bytes.assign(length, '\0');
+            return in.is_open() && in.seekg(offset) && (length == 0 || in.read(&bytes[0], length));
+        }
+
+        //Applies the entry for key to the selected machine. False on a miss.
+        bool replay(const string& key, size_t inputLength, ADDRESS& address){
+            string entryPath = path(key);
+            std::ifstream entry(entryPath, std::ios::binary);
+            if(!entry.is_open())
+                return false;
+
+            string magic;
+            int entryVersion = 0;
+            size_t length = 0;
+            unsigned long pc = 0, count = 0;
+            entry >> magic >> entryVersion >> length >> pc >> count;
+            if(!entry || magic != "SICASM-RUN" || entryVersion != version || length != inputLength)
+                return false;
+
+            //read the whole entry before anything is changed
+            struct Part{
+                string tag;
+                long at, from;
+                string bytes;
+            };
+            DynamicArray<Part> parts;
+            SICSTATE state;
+            bool haveState = false, haveRegisters = false;
+            while(true){
+                Part part;
+                part.at = part.from = 0;
+                entry >> part.tag;
+                if(!entry)
+                    return false;
+                if(part.tag == "end")
+                    break;
+                if(part.tag == "memory")
+                    entry >> part.at;
+                else if(part.tag == "output")
+                    entry >> part.at >> part.from;
+                else if(part.tag != "state" && part.tag != "registers")
+                    return false;
+                long size = 0;
+                entry >> size;
+                entry.get();
+                if(!entry || size < 0)
+                    return false;
+                part.bytes.assign(size, '\0');
+                if(size > 0 && !entry.read(&part.bytes[0], size))
+                    return false;
+
+                if(part.tag == "state"){
+                    if(!decode(part.bytes, state))
+                        return false;
+                    haveState = true;
+                }
+                else if(part.tag == "registers"){
+                    if(part.bytes.length() != sizeof(WORD) * 6)
+                        return false;
+                    haveRegisters = true;
+                }
+                else if(part.tag == "memory" && (part.at < 0 || part.at + size > MSIZE))
+                    return false;
+                else if(part.tag == "output" && (part.at < 3 || part.at > 5))
+                    return false;
+                parts.push_back(part);
+            }
+            if(!haveState || !haveRegisters || pc > MSIZE)
+                return false;
+
+            for(unsigned i = 0; i < parts.size(); i++){
+                const Part& part = parts.at(i);
+                if(part.tag == "registers")
+                    memcpy(SICRegisters(), part.bytes.data(), part.bytes.length());
+                else if(part.tag == "memory")
+                    memcpy(SICMemory() + part.at, part.bytes.data(), part.bytes.length());
+                else if(part.tag == "output" && part.from < 0)
+                    std::ofstream(file(part.at), std::ios::binary) << part.bytes;
+                else if(part.tag == "output"){
+                    std::fstream out(file(part.at), std::ios::binary | std::ios::in | std::ios::out);
+                    out.seekp(part.from);
+                    out << part.bytes;
+                }
+            }
+            SICSetState(&state);
+            PutPC(pc);
+            SICAddCount(count);
+            address = pc;
+
+            //as the engine prints it
+            if(state.Fault != 0){
+                char message[96];
+                snprintf(message, sizeof message, "\n\nAt PC = %lx: %s\n\n", pc, SICMessage(state.Fault));
+                cout << message;
+            }
+
+            utimes(entryPath.c_str(), NULL);      //most recently used
+            return true;
+        }
+
+        //Saves what the run from before to after changed under key
+        void store(const string& key, size_t inputLength, const string& input,
+                const SICSTATE& before, const SICSTATE& after, unsigned long count){
+            std::ostringstream entry;
+            entry << "SICASM-RUN " << version << " " << inputLength << "\n";
+            entry << GetPC() << " " << count << "\n";
+            string state = encode(after);
+            entry << "state " << state.length() << "\n" << state;
+            entry << "registers " << sizeof(WORD) * 6 << "\n";
+            entry.write(reinterpret_cast<const char*>(SICRegisters()), sizeof(WORD) * 6);
+
+            const BYTE* memory = SICMemory();
+            const char* previous = input.data();
+            for(long i = 0; i < MSIZE; ){
+                if(memory[i] == static_cast<BYTE>(previous[i])){
+                    i++;
+                    continue;
+                }
+                long start = i, end = i + 1;
+                for(i++; i < MSIZE && i - end < gap; i++)
+                    if(memory[i] != static_cast<BYTE>(previous[i]))
+                        end = i + 1;
+                entry << "memory " << start << " " << end - start << "\n";
+                entry.write(reinterpret_cast<const char*>(memory + start), end - start);
+            }
+
+            for(int i = 3; i < 6; i++){
+                long from = before.Position[i], to = after.Position[i];
+                if(to < 0 || to == from)
+                    continue;
+                string bytes;
+                if(to < from || !readPart(file(i), from < 0 ? 0 : from, to - (from < 0 ? 0 : from), bytes))
+                    return;
+                entry << "output " << i << " " << from << " " << bytes.length() << "\n" << bytes;
+            }
+            entry << "end\n";
+
+            mkdir(directory.c_str(), 0777);
+            string temporary = AssemblyCache::temporary(path(key));
+            {
+                std::ofstream out(temporary, std::ios::binary);
+                if(!out.is_open())
+                    return;
+                out << entry.str();
+            }
+            rename(temporary.c_str(), path(key).c_str());
+            AssemblyCache::evict(directory, capacity);
+        }
+
+        Outcome refuse(const string& reason){
+            why = reason;
+            return last = executed;
+        }
+
+    public:
+        RunCache(const string& directory = ".sicasm-cache", off_t capacity = 8 << 20) :
+            directory(directory), capacity(capacity), last(executed){}
+
+        //Runs the selected machine from address like SICRun, or replays
+        //the run from the cache if it is known
+        Outcome run(ADDRESS& address){
+            why = "";
+            SICSTATE before;
+            SICGetState(&before);
+            if(before.Attached){
+                SICRun(&address, FALSE);
+                return refuse("a device has a backend attached (see device list)");
+            }
+            if(before.Channels){
+                SICRun(&address, FALSE);
+                return refuse("a channel has a program");
+            }
+
+            string input = inputOf(address, before);
+            string key = AssemblyCache::key(input, "run " + std::to_string(version));
+            if(replay(key, input.length(), address))
+                return last = replayed;
+
+            //the totals are those of every machine, so a service called by
+            //a machine on another thread also keeps this run out
+            SICSTATS engine, done;
+            SICGetStats(&engine);
+            unsigned long count = SICCount();
+            SICRun(&address, FALSE);
+            SICGetStats(&done);
+            count = SICCount() - count;
+
+            if(SICStopped())
+                return refuse("the run was paused");
+            for(int n = 0; n < 16; n++)
+                if(done.Hypercalls[n] != engine.Hypercalls[n])
+                    return refuse("the program called host services (SVC)");
+            if(done.Counters != engine.Counters)
+                return refuse("the program used the counter device (07)");
+            SICSTATE after;
+            SICGetState(&after);
+            if(after.Channels)
+                return refuse("the program started a channel program");
+
+            store(key, input.length(), input, before, after, count);
+            return last = stored;
+        }
+
+        Outcome outcome() const{
+            return last;
+        }
+
+        //why the last run was executed without the cache
+        const string& reason() const{
+            return why;
+        }
+};
+
+#endif
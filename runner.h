@@ -0,0 +1,224 @@
+
+/*
+    Runs the SIC machine in the foreground or on a worker thread.
+
+    A background run leaves the interpreter responsive. The run can be
+    paused with stop() (or Ctrl-C), which the engine honors at the next
+    budget boundary, and continued from the same PC with resume().
+    status() reports the instruction count, the PC and the execution
+    rate of the current (or last) run.
+*/
+
+#ifndef RUNNER_H
+#define RUNNER_H
+
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include "codec.h"
+#include "util.h"
+#include "stats.h"
+#include "runcache.h"
+#include "filelock.h"
+
+extern "C"{
+    #include "sicengine.h"
+}
+
+class Runner{
+
+    private:
+        std::thread worker;
+
+        //true while the worker thread is executing
+        std::atomic<bool> active;
+
+        //the machine of the current (or last) run
+        SICMACHINE* machine;
+
+        //timing of the current (or last) run
+        std::chrono::steady_clock::time_point started;
+        std::chrono::steady_clock::time_point finished;
+        unsigned long startCount;
+
+        //where the time of every run is added
+        Stage* runStage;
+
+        //the working directory shared with other runners, NULL if none;
+        //a background run holds it until it ends
+        FileLock* files;
+
+        //what a background run printed, when its thread's output is
+        //kept for the thread that started it (see keepOutput)
+        bool keeping;
+        std::stringbuf kept;
+
+        //joins the worker and prints what it kept
+        void join(){
+            worker.join();
+            cout << kept.str();
+            kept.str("");
+        }
+
+        //joins a worker that is done running
+        void reap(){
+            if(worker.joinable() && !active)
+                join();
+        }
+
+        //Pauses the worker and joins it. The run is armed before the
+        //worker starts (see start), so the request is never lost.
+        void halt(){
+            SICStopMachine(machine);
+            join();
+        }
+
+        void begin(){
+            started = std::chrono::steady_clock::now();
+            startCount = SICCount();
+        }
+
+        void end(){
+            finished = std::chrono::steady_clock::now();
+            runStage->add(std::chrono::duration<double>(finished - started).count());
+        }
+
+        void report(){
+            if(SICStopped())
+                cout << "\nPaused at PC = " << Codec::hexValue(GetPC(), 1) << "\n";
+        }
+
+        //the selected machine is per thread, the worker selects
+        //the machine of the thread that started it
+        static void work(Runner* runner, SICMACHINE* machine, ADDRESS address){
+            if(runner->keeping)
+                cout.rdbuf(&runner->kept);
+            SICSelect(machine);
+            SICRun(&address, FALSE);
+            runner->end();
+            runner->report();
+            if(runner->files != NULL)
+                runner->files->unlock();
+            runner->active = false;
+        }
+
+    public:
+        Runner(Stage* runStage) : active(false), machine(NULL), startCount(0), runStage(runStage), files(NULL), keeping(false){
+            started = finished = std::chrono::steady_clock::now();
+        }
+
+        //a background run is never left detached
+        ~Runner(){
+            if(worker.joinable())
+                halt();
+        }
+
+        //Keeps what background runs print until the thread that started
+        //them joins them (the next isActive, stop or resume), for a thread
+        //whose output goes somewhere the worker's does not
+        void keepOutput(){
+            keeping = true;
+        }
+
+        //Shares the files of runs with other runners (see filelock.h)
+        void shareFiles(FileLock* lock){
+            files = lock;
+        }
+
+        bool isActive(){
+            reap();
+            return active;
+        }
+
+        //Runs the machine from address. A foreground run goes through
+        //memo when it is given (see runcache.h).
+        //Returns false if the machine is already running or if a
+        //foreground run stopped because of a fault.
+        bool start(ADDRESS address, bool background, RunCache* memo = NULL){
+            if(isActive()){
+                cout << "The machine is already running. Use 'stop' first.\n";
+                return false;
+            }
+            begin();
+            machine = SICCurrent();
+
+            if(background){
+                SICArm();
+                if(files != NULL)
+                    files->lock(this);
+                active = true;
+                worker = std::thread(work, this, machine, address);
+                return true;
+            }
+
+            if(memo != NULL)
+                memo->run(address);
+            else
+                SICRun(&address, FALSE);
+            end();
+            report();
+            return SICFault() == 0;
+        }
+
+        //Continues a paused run from the current PC
+        bool resume(bool background){
+            if(isActive()){
+                cout << "The machine is already running.\n";
+                return false;
+            }
+            if(!SICStopped()){
+                cout << "There is no paused run to resume.\n";
+                return false;
+            }
+            return start(GetPC(), background);
+        }
+
+        //Ends a background run and forgets the last one, for a new
+        //machine that takes the place of the old
+        void reset(){
+            if(worker.joinable()){
+                SICStopMachine(machine);
+                worker.join();
+            }
+            kept.str("");
+            started = finished = std::chrono::steady_clock::now();
+            startCount = 0;
+        }
+
+        //Requests a pause and waits for the worker to reach it
+        bool stop(){
+            if(!isActive()){
+                cout << "The machine is not running.\n";
+                return false;
+            }
+            halt();
+            return true;
+        }
+
+        void status(){
+            bool running = isActive();
+            std::chrono::steady_clock::time_point now =
+                running ? std::chrono::steady_clock::now() : finished;
+
+            double seconds = std::chrono::duration<double>(now - started).count();
+            unsigned long executed = SICCount() - startCount;
+
+            cout << "State:        ";
+            if(running)             cout << "running\n";
+            else if(SICStopped())   cout << "paused\n";
+            else                    cout << "idle\n";
+
+            cout << "Instructions: " << SICCount() << "\n";
+            cout << "Cycles:       " << SICCycles() << "\n";
+            cout << "PC:           " << Codec::hexValue(GetPC(), 6) << "\n";
+
+            cout << "Rate:         ";
+            if(seconds > 0)
+                cout << (unsigned long)(executed / seconds) << " instructions/sec\n";
+            else
+                cout << "-\n";
+        }
+};
+
+#endif
@@ -0,0 +1,197 @@
+
+/*
+    Cooperative scheduler for many machines on a few host threads.
+
+    A machine added to the scheduler runs in cooperative mode: when its
+    program polls a busy device (TD) the engine returns from SICSlice
+    instead of letting it spin in its TD/JEQ loop. Everything needed to
+    resume it is in the machine itself, so the host thread just moves on
+    to the next machine in the ready queue. Machines that keep computing
+    are preempted after a slice of instructions so none can starve the
+    others.
+
+    A machine that yielded on a device that is still busy (SICWaiting),
+    such as a pipe nobody has written to yet, is parked instead of being
+    queued again. After every slice the parked machines whose device got
+    ready go back to the ready queue. When every machine is parked, the
+    threads sleep until a slice ends or a short timeout passes, so a run
+    whose machines all wait does not keep the host busy.
+
+    A machine leaves the scheduler when it stops because of a fault
+    (which is how programs end) or when the run is stopped.
+*/
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include "dynamic_array.h"
+#include "util.h"
+
+extern "C"{
+    #include "sicengine.h"
+}
+
+class Scheduler{
+
+    public:
+        //A machine under the scheduler
+        struct Task{
+            string name;
+            SICMACHINE* machine;
+
+            //times it gave up its thread on a busy device
+            unsigned long yields;
+
+            //slices it ran
+            unsigned long slices;
+
+            //how its last slice ended (SIC_FAULTED ...)
+            int state;
+
+            Task() : name(""), machine(NULL), yields(0), slices(0), state(SIC_PREEMPTED){}
+            Task(const string& name, SICMACHINE* machine) :
+                name(name), machine(machine), yields(0), slices(0), state(SIC_PREEMPTED){}
+        };
+
+    private:
+        DynamicArray<Task> tasks;
+
+        //indices of the tasks that can run, and of those waiting
+        //for a busy device
+        std::deque<unsigned> ready;
+        std::deque<unsigned> parked;
+        std::mutex lock;
+
+        //signalled when a slice ends
+        std::condition_variable changed;
+
+        //tasks in a slice on some thread
+        unsigned busy;
+
+        //set to end the run at the next slice boundary
+        std::atomic<bool> stopping;
+
+        //instructions a machine runs before it is preempted
+        unsigned long slice;
+
+        //Moves the parked tasks whose device got ready to the ready
+        //queue. Called with lock held.
+        void wake(){
+            for(size_t i = 0; i < parked.size(); ){
+                SICSelect(tasks.at(parked.at(i)).machine);
+                if(SICWaiting()){
+                    i++;
+                    continue;
+                }
+                ready.push_back(parked.at(i));
+                parked.erase(parked.begin() + i);
+            }
+        }
+
+        //Takes the next task off the ready queue, waiting while every
+        //task left is parked. Returns false when there is nothing left
+        //to run.
+        bool next(unsigned& index){
+            std::unique_lock<std::mutex> guard(lock);
+            while(!stopping){
+                wake();
+                if(!ready.empty()){
+                    index = ready.front();
+                    ready.pop_front();
+                    busy++;
+                    return true;
+                }
+                //the tasks of other threads may still come back
+                if(parked.empty() && busy == 0)
+                    return false;
+                changed.wait_for(guard, std::chrono::milliseconds(1));
+            }
+            return false;
+        }
+
+        void done(unsigned index, int state){
+            std::lock_guard<std::mutex> guard(lock);
+            busy--;
+            if(state == SIC_PREEMPTED)
+                ready.push_back(index);
+            else if(state == SIC_BLOCKED){
+                //the task is still selected on this thread
+                if(SICWaiting())
+                    parked.push_back(index);
+                else
+                    ready.push_back(index);
+            }
+            changed.notify_all();
+        }
+
+        static void work(Scheduler* scheduler){
+            unsigned index = 0;
+            while(scheduler->next(index)){
+                Task& task = scheduler->tasks.at(index);
+
+                SICSelect(task.machine);
+                task.state = SICSlice(scheduler->slice);
+                task.slices++;
+
+                if(task.state == SIC_BLOCKED)
+                    task.yields++;
+                scheduler->done(index, task.state);
+            }
+        }
+
+    public:
+        Scheduler(unsigned long slice = 65536) : busy(0), stopping(false), slice(slice){}
+
+        //Adds a machine that starts running at entry.
+        //The machine is put in cooperative mode.
+        void add(const string& name, SICMACHINE* machine, ADDRESS entry){
+            SICMACHINE* previous = SICCurrent();
+            SICSelect(machine);
+            SICCooperate(TRUE);
+            PutPC(entry);
+            SICSelect(previous);
+
+            ready.push_back(tasks.size());
+            tasks.push_back(Task(name, machine));
+        }
+
+        //Runs the machines on threads host threads until all of them
+        //have ended or stop() is called. The machines are left in
+        //normal (non cooperative) mode.
+        void run(unsigned threads){
+            stopping = false;
+            if(threads == 0)
+                threads = 1;
+
+            DynamicArray<std::thread> workers;
+            for(unsigned i = 0; i < threads; i++)
+                workers.emplace_back(work, this);
+            for(unsigned i = 0; i < workers.size(); i++)
+                workers.at(i).join();
+
+            SICMACHINE* previous = SICCurrent();
+            for(unsigned i = 0; i < tasks.size(); i++){
+                SICSelect(tasks.at(i).machine);
+                SICCooperate(FALSE);
+            }
+            SICSelect(previous);
+        }
+
+        //Ends a run at the next slice boundary. Safe to call from a
+        //signal handler.
+        void stop(){
+            stopping = true;
+        }
+
+        const DynamicArray<Task>& getTasks() const{
+            return tasks;
+        }
+};
+
+#endif
@@ -0,0 +1,113 @@
+
+/*
+    Host services for the instruction SVC n.
+
+    A SIC program calls the routines it spends most of its time in as
+    one instruction instead of a loop of them. The standard services
+    take their operands in registers: A is a length or value, S the
+    source address and T the destination address.
+
+        SVC 0   MOVE     copies A bytes from S to T (the ranges may overlap)
+        SVC 1   FILL     sets A bytes at T to the low byte of S
+        SVC 2   DECIMAL  writes A as signed decimal characters at T and
+                         sets A to the number of characters
+        SVC 3   COMPARE  compares A bytes at S with A bytes at T and sets
+                         CC ('<', '=' or '>') like memcmp
+
+    Other services can be added with SICService. The calls made to each
+    service are counted in the run statistics.
+*/
+
+#ifndef SERVICES_H
+#define SERVICES_H
+
+#include <cstring>
+#include "util.h"
+
+extern "C"{
+    #include "sicengine.h"
+}
+
+class Services{
+
+    private:
+        //error numbers of the engine
+        static const int invalidAddress = 3;
+
+        static unsigned long value(const WORD w){
+            return (w[0] << 16) | (w[1] << 8) | w[2];
+        }
+
+        static void setValue(WORD w, unsigned long v){
+            w[0] = (v >> 16) & 0xFF;
+            w[1] = (v >> 8) & 0xFF;
+            w[2] = v & 0xFF;
+        }
+
+        //true if the length bytes at address are in memory
+        static bool inMemory(unsigned long address, unsigned long length){
+            return address <= MSIZE && length <= MSIZE - address;
+        }
+
+        static int move(void*){
+            WORD* r = SICRegisters();
+            unsigned long length = value(r[0]), from = value(r[4]), to = value(r[5]);
+            if(!inMemory(from, length) || !inMemory(to, length))
+                return invalidAddress;
+            BYTE* memory = SICMemory();
+            memmove(memory + to, memory + from, length);
+            return 0;
+        }
+
+        static int fill(void*){
+            WORD* r = SICRegisters();
+            unsigned long length = value(r[0]), to = value(r[5]);
+            if(!inMemory(to, length))
+                return invalidAddress;
+            memset(SICMemory() + to, r[4][2], length);
+            return 0;
+        }
+
+        static int decimal(void*){
+            WORD* r = SICRegisters();
+            long a = value(r[0]);
+            if(a & 0x800000)
+                a -= 0x1000000;
+            unsigned long to = value(r[5]);
+
+            string text = std::to_string(a);
+            if(!inMemory(to, text.length()))
+                return invalidAddress;
+            memcpy(SICMemory() + to, text.data(), text.length());
+            setValue(r[0], text.length());
+            return 0;
+        }
+
+        static int compare(void*){
+            WORD* r = SICRegisters();
+            unsigned long length = value(r[0]), from = value(r[4]), to = value(r[5]);
+            if(!inMemory(from, length) || !inMemory(to, length))
+                return invalidAddress;
+            BYTE* memory = SICMemory();
+            int result = memcmp(memory + from, memory + to, length);
+            PutCC(result < 0 ? '<' : result == 0 ? '=' : '>');
+            return 0;
+        }
+
+    public:
+        //Registers the standard services for every machine
+        static void install(){
+            SICService(0, &move, NULL);
+            SICService(1, &fill, NULL);
+            SICService(2, &decimal, NULL);
+            SICService(3, &compare, NULL);
+        }
+
+        //name of a standard service, "" for the others
+        static string name(int n){
+            static const char* names[] = {"MOVE", "FILL", "DECIMAL", "COMPARE"};
+            return n >= 0 && n < 4 ? names[n] : "";
+        }
+};
+
+#endif
@@ -0,0 +1,193 @@
+
+/*
+    Named machine sessions.
+
+    Each session owns a SIC machine (memory, registers and devices)
+    along with the metadata of the programs loaded into it, such as
+    the first executable address from the end record. Several relocated
+    programs can be resident at once; "program use" makes another one
+    the program that execute runs, without reloading it.
+    The interpreter commands always act on the current session.
+    Switching sessions only selects another machine in the engine,
+    no memory is copied.
+
+    The first session, "main", uses the machine created by SICInit().
+*/
+
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <unordered_map>
+#include <memory>
+#include "util.h"
+#include "loader.h"
+#include "devices.h"
+
+extern "C"{
+    #include "sicengine.h"
+}
+
+using std::unordered_map;
+using std::shared_ptr;
+
+struct Session{
+    string name;
+    SICMACHINE* machine;
+
+    //first executable address of the current program (hex)
+    string firstAddress;
+
+    //programs resident in memory, by name
+    unordered_map<string, Program> programs;
+
+    //backends attached to the devices (F1-F3, 04-06), empty for the
+    //default files. A pipe is shared by the two sessions it connects.
+    shared_ptr<Device> devices[6];
+
+    Session() : name(""), machine(NULL), firstAddress(""){}
+    Session(const string& name, SICMACHINE* machine) :
+        name(name), machine(machine), firstAddress(""){}
+
+    //Records a newly loaded program and makes it the current one.
+    //Programs it overwrote are no longer resident.
+    void addProgram(const Program& program){
+        unordered_map<string, Program>::iterator itr = programs.begin();
+        while(itr != programs.end()){
+            if(itr->second.overlaps(program) || itr->first == program.name)
+                itr = programs.erase(itr);
+            else itr++;
+        }
+        programs[program.name] = program;
+        firstAddress = Codec::hexValue(program.entry, 6);
+    }
+
+    //Attaches device to the device number index (0 to 5) of the machine.
+    //An empty device goes back to the default file.
+    void attach(int index, const shared_ptr<Device>& device){
+        SICMACHINE* previous = SICCurrent();
+        SICSelect(machine);
+        SICAttach(index, device ? device->handle() : NULL);
+        SICSelect(previous);
+        devices[index] = device;
+    }
+
+    void displayDevices() const{
+        static const char* codes[6] = {"F1", "F2", "F3", "04", "05", "06"};
+        static const char* files[6] = {"devf1", "devf2", "devf3", "dev04", "dev05", "dev06"};
+        for(int i = 0; i < 6; i++){
+            cout << codes[i] << "\t";
+            if(devices[i])
+                cout << devices[i]->describe() << endl;
+            else
+                cout << "file " << files[i] << endl;
+        }
+        cout << "07\tcounters (instructions, cycles, time), read only by programs" << endl;
+    }
+
+    //The resident program that holds address, NULL if none
+    const Program* programAt(int address) const{
+        unordered_map<string, Program>::const_iterator itr;
+        for(itr = programs.begin(); itr != programs.end(); itr++)
+            if(itr->second.contains(address))
+                return &itr->second;
+        return NULL;
+    }
+
+    //Makes a resident program the current one
+    bool useProgram(const string& name){
+        unordered_map<string, Program>::const_iterator itr = programs.find(name);
+        if(itr == programs.end())
+            return false;
+        firstAddress = Codec::hexValue(itr->second.entry, 6);
+        return true;
+    }
+
+    void displayPrograms() const{
+        unordered_map<string, Program>::const_iterator itr;
+        for(itr = programs.begin(); itr != programs.end(); itr++){
+            const Program& p = itr->second;
+            cout << (Codec::hexValue(p.entry, 6) == firstAddress ? "* " : "  ");
+            cout << p.name << "\t" << Codec::hexValue(p.start, 6) << "-";
+            cout << Codec::hexValue(p.start + p.length - 1, 6);
+            cout << "\tentry " << Codec::hexValue(p.entry, 6) << endl;
+        }
+    }
+};
+
+class SessionTable{
+
+    private:
+        unordered_map<string, Session> sessions;
+
+        //the session the commands act on
+        Session* currentSession;
+
+    public:
+        //Must be created after SICInit()
+        SessionTable(){
+            sessions["main"] = Session("main", SICCurrent());
+            currentSession = &sessions["main"];
+        }
+
+        //the "main" machine belongs to the engine
+        ~SessionTable(){
+            unordered_map<string, Session>::iterator itr;
+            for(itr = sessions.begin(); itr != sessions.end(); itr++)
+                if(itr->first != "main" && itr->second.machine != SICCurrent())
+                    SICFree(itr->second.machine);
+        }
+
+        Session& current(){
+            return *currentSession;
+        }
+
+        bool exists(const string& name) const{
+            return sessions.find(name) != sessions.end();
+        }
+
+        //Creates a session with a fresh machine. Returns false if the name is taken.
+        bool create(const string& name){
+            if(exists(name))
+                return false;
+            sessions[name] = Session(name, SICNew());
+            return true;
+        }
+
+        //Makes name the current session. Returns false if it does not exist.
+        bool use(const string& name){
+            unordered_map<string, Session>::iterator itr = sessions.find(name);
+            if(itr == sessions.end())
+                return false;
+
+            currentSession = &itr->second;
+            SICSelect(currentSession->machine);
+            return true;
+        }
+
+        Session* find(const string& name){
+            unordered_map<string, Session>::iterator itr = sessions.find(name);
+            return itr == sessions.end() ? NULL : &itr->second;
+        }
+
+        //Collects the sessions that have a program to execute
+        void withPrograms(DynamicArray<Session*>& list){
+            unordered_map<string, Session>::iterator itr;
+            for(itr = sessions.begin(); itr != sessions.end(); itr++)
+                if(!itr->second.firstAddress.empty())
+                    list.push_back(&itr->second);
+        }
+
+        //Lists the sessions, marking the current one with '*'
+        void display() const{
+            unordered_map<string, Session>::const_iterator itr;
+            for(itr = sessions.begin(); itr != sessions.end(); itr++){
+                cout << (&itr->second == currentSession ? "* " : "  ");
+                cout << itr->first;
+                if(!itr->second.firstAddress.empty())
+                    cout << "\tentry " << itr->second.firstAddress;
+                cout << endl;
+            }
+        }
+};
+
+#endif
@@ -9,12 +9,31 @@
 
     1. floating-point data type and instructions (ADDF, COMPF, DIVF, FIX,
        FLOAT, LDF, MULF, NORM, STF, SUBF)
-    2. i/o channels and associated instructions (SIO, TIO, HIO)
-    3. interrupts and associated instructions (LPS, STI, SVC)
-    4. certain features associated with register SW (user/supervisor modes,
+    2. interrupts and associated instructions (LPS, STI, SVC)
+    3. certain features associated with register SW (user/supervisor modes,
        running/idle states)
-    5. virtual memory and associated instructions (LPM)
-    6. memory protection and associated instructions (SSK)
+    4. virtual memory and associated instructions (LPM)
+    5. memory protection and associated instructions (SSK)
+
+ Several machines (CPUs) can share one memory, each running on its own
+ host thread (see SICNewShared). The instruction TS (X'8C', not part of
+ SIC/XE) atomically sets a byte to X'FF' for locking between them.
+
+The i/o channels (SIO, TIO, HIO) move a whole record between a device
+and memory per channel command instead of one byte per RD or WD; the
+transfer is simulated as a block copy (see ChanIO).
+
+Device 07 is the counter device, for programs that measure
+themselves. RD reads a record of three 6 byte numbers (high byte
+first), one byte per RD: the instructions executed, the simulated
+cycles and the host nanoseconds since the last mark. WD 0 marks the
+start of a region; WD 1 takes a reading to be read afterwards. A
+cycle is one byte of instruction fetched or of memory operand moved
+(see OpBytes). The device needs no TD.
+
+Register F is kept as a host double. Floating-point values in memory
+use the 48 bit SIC/XE format and are converted exactly when loaded and
+rounded to nearest when stored (see FGet and FPut).
 
  For a simulator that supports only standard SIC features, set the
  global constant XE to FALSE.
@@ -32,9 +51,13 @@
 */
 
 #include <stdio.h>
+#include <stdarg.h>
 #include <ctype.h>
 #include <string.h>
 #include <stdlib.h>
+#include <signal.h>
+#include <math.h>
+#include <time.h>
 
                 /* Define a few constants */
 #define TRUE    1                       /* Boolean constants */
@@ -46,6 +69,27 @@
 #define GT      3
 #define XE      TRUE                    /* determines if XE features */
                                         /*  are supported */
+#define IDIOMS  TRUE                    /* run recognized byte loops */
+                                        /*  as one host operation */
+#define BUDGET  4096                    /* instructions executed between */
+                                        /*  checks for stop requests */
+#define SIC_FAULTED     0               /* why SICSlice returned: error, */
+#define SIC_STOPPED     1               /*  stop request, busy device or */
+#define SIC_BLOCKED     2               /*  instruction limit reached */
+#define SIC_PREEMPTED   3
+#define RUN_IDLE        0               /* run states: no run, a run is */
+#define RUN_ARMED       1               /*  about to start, a run is in */
+#define RUN_ACTIVE      2               /*  progress, a pause was asked */
+#define RUN_STOP        3
+#define CHANNELS        16              /* i/o channels per machine */
+#define COUNTERS        6               /* device 07, the counter device */
+#define CH_IDLE         0               /* channel states: no program */
+#define CH_PENDING      1               /*  started, not yet run */
+#define CH_DONE         2               /*  ended normally */
+#define CH_SHORT        3               /*  ended early or halted */
+#define SIC_ORDER_SC    0               /* memory ordering between CPUs */
+#define SIC_ORDER_RELAXED 1             /*  sharing memory: a fence after */
+                                        /*  every instruction, or none */
 
                 /* Define some useful data types */
 typedef unsigned char   BYTE;
@@ -54,6 +98,41 @@ typedef BYTE            FLOAT[4];
 typedef unsigned char   BOOLEAN;
 typedef unsigned long   ADDRESS;
 typedef char*           MESSAGE;
+typedef struct {
+        unsigned long Instructions;     /* instructions executed */
+        unsigned long DevRead;          /* bytes read by RD */
+        unsigned long DevWritten;       /* bytes written by WD */
+        unsigned long Faults;           /* runs stopped by an error */
+        unsigned long Hypercalls[16];   /* SVC calls per service number */
+        unsigned long Idioms;           /* loops run as one host operation */
+        unsigned long Counters;         /* RD and WD on the counter device */
+     } SICSTATS;
+typedef struct {                        /* what a machine holds besides */
+                                        /*  its memory, registers and PC */
+        WORD SW;                        /* status word */
+        double F;                       /* floating point register */
+        int Fault;                      /* error number of the last run */
+        unsigned long Clock;            /* simulated cycles (SICCycles) */
+        long Position[6];               /* offset in the file of each */
+                                        /*  device, -1 if it is not open */
+        BOOLEAN AtEnd[6];               /* its file has been read to the end */
+        BOOLEAN EndRead[6];             /* RD has reported the end */
+        BYTE Countdown[6];              /* TD countdown of each device */
+        BOOLEAN Attached;               /* some device has a backend */
+        BOOLEAN Channels;               /* some channel has a program */
+     } SICSTATE;
+typedef int (*SICSERVICE)(void *);      /* host routine for SVC n, returns */
+                                        /*  an error number, 0 if none */
+typedef void (*SICPRINT)(const char *); /* receives a message of the engine */
+typedef struct SICDevice SICDEVICE;
+struct SICDevice {                      /* backend of an I/O device */
+        BOOLEAN (*Ready)(SICDEVICE *, BOOLEAN); /* can a byte be read (or */
+                                                /*  written if TRUE) now */
+        int (*Read)(SICDEVICE *);               /* next byte, -1 at the end */
+        void (*Write)(SICDEVICE *, BYTE);
+        void (*End)(SICDEVICE *);               /* the writer has stopped */
+        void *Data;                             /* state of the backend */
+     };
 typedef struct {
         char OP[7];
         short FORM;
@@ -68,7 +147,7 @@ OPCODE Ops[] = {{"LDA   ", 3}, {"LDX   ", 3}, {"LDL   ", 3}, {"STA   ", 3},
                 {"LDCH  ", 3}, {"STCH  ", 3}, {"ADDF  ", 3}, {"SUBF  ", 3},
                 {"MULF  ", 3}, {"DIVF  ", 3}, {"LDB   ", 3}, {"LDS   ", 3},
                 {"LDF   ", 3}, {"LDT   ", 3}, {"STB   ", 3}, {"STS   ", 3},
-                {"STF   ", 3}, {"STT   ", 3}, {"COMPF ", 3}, {"      ", 0},
+                {"STF   ", 3}, {"STT   ", 3}, {"COMPF ", 3}, {"TS    ", 3},
                 {"ADDR  ", 2}, {"SUBR  ", 2}, {"MULR  ", 2}, {"DIVR  ", 2},
                 {"COMPR ", 2}, {"SHIFTL", 2}, {"SHIFTR", 2}, {"RMO   ", 2},
                 {"SVC   ", 2}, {"CLEAR ", 2}, {"TIXR  ", 2}, {"      ", 0},
@@ -77,46 +156,206 @@ OPCODE Ops[] = {{"LDA   ", 3}, {"LDX   ", 3}, {"LDL   ", 3}, {"STA   ", 3},
                 {"TD    ", 3}, {"      ", 0}, {"STSW  ", 3}, {"SSK   ", 3},
                 {"SIO   ", 1}, {"HIO   ", 1}, {"TIO   ", 1}, {"      ", 0}};
 
-                /* Define the CPU variables */
-WORD Registers[6];      /* holds registers A, X, L, B, S, T */
-ADDRESS PC;             /* holds PC */
-WORD Status;            /* status word */
-FLOAT Fl;               /* Floating point accumulator */
+                /* The state of one simulated machine. Several machines can
+                   exist at once; the engine always operates on the one
+                   selected by SICSelect, so switching is a pointer swap. */
+typedef struct SICMachine {
+                /* CPU variables */
+        WORD Registers[6];      /* holds registers A, X, L, B, S, T */
+        ADDRESS PC;             /* holds PC */
+        WORD Status;            /* status word */
+        double Fl;              /* Floating point accumulator (register F) */
 
                 /* Input/Output variables */
+        FILE *Dev[6];
+        SICDEVICE *Backend[6];  /* attached backends, NULL to use SICFile */
+        BYTE Wait[6];
+        BOOLEAN Init[6],
+                EndFile[6],
+                EndLine[6];     /* a backend has ended its last line */
+        ADDRESS ChanProgram[CHANNELS];  /* channel programs started by SIO */
+        BYTE ChanState[CHANNELS];       /* CH_IDLE ... */
+        BOOLEAN ChanPending;            /* some channel is CH_PENDING */
+
+                /* Memory variables */
+        BYTE *Memory;           /* main memory, MSIZE bytes */
+        ADDRESS MAR;            /* memory address register */
+        WORD MBR;               /* memory buffer register */
+
+        BOOLEAN ERROR;          /* generic error flag */
+        int LastError;          /* error number of the last fault, 0 if none */
+
+                /* Run control variables */
+        unsigned long ICount;   /* instructions executed since reset/SICClearCount */
+        BOOLEAN Stopped;        /* last run was paused by a stop request */
+        int RunState;           /* RUN_IDLE..RUN_STOP, only changed */
+                                /*  with __atomic operations */
+
+                /* Cooperative scheduling variables */
+        BOOLEAN Cooperative;    /* yield on a busy device instead of spinning */
+        BOOLEAN Blocked;        /* the last slice yielded on a busy device */
+        int BlockedOn;          /* that device, 0 to 5 */
+
+                /* Multiprocessor variables */
+        BOOLEAN SharedMemory;   /* Memory belongs to another machine */
+        BOOLEAN Sharing;        /* other CPUs run on Memory (SICSharing) */
+        int Ordering;           /* SIC_ORDER_SC or SIC_ORDER_RELAXED */
+        int MemoryLock;         /* held by a CPU running an instruction */
+        int *Lock;              /*  on Memory in SC order; the one of */
+                                /*  the machine that owns Memory */
+
+                /* Counter device variables */
+        unsigned long Cycles;   /* simulated cycles, cleared with ICount */
+        unsigned long MarkCount;        /* ICount, Cycles and the host */
+        unsigned long MarkCycles;       /*  time at the last mark */
+        struct timespec MarkTime;
+        BYTE Reading[18];       /* the record read by RD */
+        int ReadNext;           /* its next byte */
+        BOOLEAN Taken;          /* WD 1 took it, RD reads it as it is */
+
+                /* The list of all machines (see SICStopAll) */
+        struct SICMachine *ListPrev, *ListNext;
+     } SICMACHINE;
+
+                /* The selected machine. Every host thread selects its own,
+                   so several machines can run at once on different threads. */
+__thread SICMACHINE *Mach;
+
+                /* The simulator routines refer to the state of the
+                   selected machine through these names */
+#define Registers       (Mach->Registers)
+#define PC              (Mach->PC)
+#define Status          (Mach->Status)
+#define Fl              (Mach->Fl)
+#define Dev             (Mach->Dev)
+#define Backend         (Mach->Backend)
+#define Wait            (Mach->Wait)
+#define Init            (Mach->Init)
+#define EndFile         (Mach->EndFile)
+#define EndLine         (Mach->EndLine)
+#define ChanProgram     (Mach->ChanProgram)
+#define ChanState       (Mach->ChanState)
+#define ChanPending     (Mach->ChanPending)
+#define Memory          (Mach->Memory)
+#define MAR             (Mach->MAR)
+#define MBR             (Mach->MBR)
+#define ERROR           (Mach->ERROR)
+#define LastError       (Mach->LastError)
+#define ICount          (Mach->ICount)
+#define Stopped         (Mach->Stopped)
+#define RunState        (Mach->RunState)
+#define Cooperative     (Mach->Cooperative)
+#define Blocked         (Mach->Blocked)
+#define BlockedOn       (Mach->BlockedOn)
+#define SharedMemory    (Mach->SharedMemory)
+#define Sharing         (Mach->Sharing)
+#define Ordering        (Mach->Ordering)
+#define Lock            (Mach->Lock)
+#define Cycles          (Mach->Cycles)
+#define MarkCount       (Mach->MarkCount)
+#define MarkCycles      (Mach->MarkCycles)
+#define MarkTime        (Mach->MarkTime)
+#define Reading         (Mach->Reading)
+#define ReadNext        (Mach->ReadNext)
+#define Taken           (Mach->Taken)
+
+                /* Input/Output variables shared by all machines */
 FILE  *DevBoot;
-FILE *Dev[6];
 char *SICFile[6] = {"devf1", "devf2", "devf3", "dev04", "dev05", "dev06"};
-BYTE Wait[6];
-BOOLEAN Init[6],
-        EndFile[6];
 BYTE InTab[256], OutTab[256];
 
-                /* Memory variables */
-BYTE Memory[MSIZE];     /* main memory */
-ADDRESS MAR;            /* memory address register */
-WORD MBR;               /* memory buffer register */
+                /* Host routines called by SVC, shared by all machines */
+SICSERVICE SvcHandler[16];
+void *SvcData[16];
+
+                /* Where the messages of the engine go (see SICPrinter),
+                   NULL for the standard output */
+SICPRINT Printer;
+
+                /* Every machine that exists, newest first, for SICStopAll.
+                   ListLock is held while the list is changed or walked;
+                   once Closing is set every run pauses as it starts. */
+SICMACHINE *AllMachines;
+int ListLock;
+int Closing;
+
+                /* Totals over all machines and runs (see SICGetStats).
+                   Machines on other threads add to them atomically. */
+SICSTATS Totals;
+
+                /* Memory operand bytes of each instruction, by opcode / 4
+                   as in Ops, for the simulated cycle count */
+BYTE OpBytes[64] = {3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 0, 0, 0, 0,
+                    3, 3, 0, 0, 1, 1, 6, 6, 6, 6, 3, 3, 6, 3, 3, 3,
+                    6, 3, 6, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                    0, 0, 0, 0, 3, 3, 1, 1, 1, 0, 3, 3, 0, 0, 0, 0};
 
                 /* Miscellaneous variables */
 WORD Word1;             /* holds the constant 1 */
-BOOLEAN ERROR;          /* generic error flag */
 char *Msg[16];             /* holds error messages */
 
                 /* Function prototypes */
                                             /* first the user interface */
 void GetMem (ADDRESS, BYTE*, int);
 void PutMem (ADDRESS, BYTE*, int);
+void PutMemBlock (ADDRESS, BYTE*, long);
+void GetMemBlock (ADDRESS, BYTE*, long);
 void GetReg (WORD*);
 void PutReg (WORD*);
 ADDRESS GetPC (void);
 void PutPC (ADDRESS);
 void GetIR (ADDRESS, char *);
 char GetCC (void);
+void PutCC (char);
 void SICRun (ADDRESS *, BOOLEAN);
+int SICSlice (unsigned long);
+void SICCooperate (BOOLEAN);
+BOOLEAN SICWaiting (void);
+void SICAttach (int, SICDEVICE *);
+int SICCharIO (int, BYTE, WORD);
+void SICAddCount (unsigned long);
+void SICAddCycles (unsigned long);
+int SICOpCycles (int);
 void SICInit (void);
+int SICFault (void);
+void SICStop (void);
+void SICArm (void);
+BOOLEAN SICStopped (void);
+BOOLEAN SICRunning (void);
+unsigned long SICCount (void);
+void SICClearCount (void);
+SICMACHINE *SICNew (void);
+void SICFree (SICMACHINE *);
+SICMACHINE *SICNewShared (SICMACHINE *);
+void SICOrdering (int);
+void SICSharing (BOOLEAN);
+void SICStopMachine (SICMACHINE *);
+void SICStopAll (void);
+BOOLEAN SICClosing (void);
+void ListAdd (SICMACHINE *);
+void ListRemove (SICMACHINE *);
+void SICSelect (SICMACHINE *);
+SICMACHINE *SICCurrent (void);
+void SICGetStats (SICSTATS *);
+void SICService (int, SICSERVICE, void *);
+BYTE *SICMemory (void);
+WORD *SICRegisters (void);
+unsigned long SICCycles (void);
+void SICGetState (SICSTATE *);
+void SICSetState (SICSTATE *);
+char *SICMessage (int);
+void SICPrinter (SICPRINT);
                                             /* now the internal routines */
+void SICPrint (char *, ...);
 void SICError (int);
 int SICEoln (FILE *);
+void CounterMark (void);
+void CounterTake (void);
+int CounterGet (void);
+unsigned long LoopCycles (ADDRESS, int);
+int SICLoop (BOOLEAN, unsigned long);
+void SICEnter (void);
+void SICLeave (void);
 void GetAddr(int, WORD, BOOLEAN, ADDRESS *);
 void GetData(int, WORD, BOOLEAN, BOOLEAN, WORD, ADDRESS *);
 void Shift (BYTE *, int, int);
@@ -132,10 +371,26 @@ void Jump (int, WORD, BOOLEAN, BOOLEAN, ADDRESS *);
 void Arith (int, WORD, BOOLEAN, BOOLEAN, WORD, ADDRESS *);
 void Logic (int, WORD, BOOLEAN, BOOLEAN, WORD, ADDRESS *);
 void CharIO (int, WORD, BOOLEAN, BOOLEAN, WORD, ADDRESS *);
+int DevGet (int);
+void DevPut (int, BYTE);
+void Channel (int);
+void ChanRun (void);
+void ChanIO (int);
+double FGet (ADDRESS);
+void FPut (ADDRESS, double);
+void FCheck (void);
+void Float (int, WORD, BOOLEAN, BOOLEAN, ADDRESS *);
+void FloatReg (int);
+void Service (int);
+BOOLEAN IsOp (ADDRESS, int, BOOLEAN, ADDRESS *);
+BOOLEAN Idiom (unsigned long);
 void RegReg (int, int, int);
 void RegMan (int, int, int);
 void SICExec (int, int, int, WORD, BOOLEAN, BOOLEAN);
 void SICStart (void);
+void SICReset (void);
+void SICResetCPU (void);
+void TestSet (WORD, BOOLEAN, BOOLEAN, ADDRESS *);
 void DecMode (BOOLEAN *, BOOLEAN *, BOOLEAN *, BOOLEAN *, BOOLEAN *,
         BOOLEAN *, BOOLEAN *, BOOLEAN, BOOLEAN);
 void DecAddr (WORD, BOOLEAN *, BOOLEAN *, BOOLEAN *, BOOLEAN *, BOOLEAN *,
@@ -143,6 +398,25 @@ void DecAddr (WORD, BOOLEAN *, BOOLEAN *, BOOLEAN *, BOOLEAN *, BOOLEAN *,
 void SICFetch (int *, int *, int *, WORD, BOOLEAN *, BOOLEAN *, BOOLEAN *,
         BOOLEAN *, BOOLEAN *, BOOLEAN *);
 
+/******************************************************************/
+void SICPrint (char *Format, ...)
+{
+  /* Prints a message of the engine like printf, through the routine
+     given to SICPrinter if there is one */
+
+  char text[256];
+  va_list args;
+
+     va_start(args, Format);
+     if (Printer == NULL)
+         vprintf(Format, args);
+     else {
+         vsnprintf(text, sizeof text, Format, args);
+         Printer(text);
+     }
+     va_end(args);
+}
+
 /******************************************************************/
 void SICError (int n)
 {
@@ -150,8 +424,10 @@ void SICError (int n)
      and displays an appropriate error message */
 
      Status[2] = (Status[2] & 0xF) | n;
-     printf("\n\nAt PC = %x: %s\n\n", PC, Msg[n]);
+     SICPrint("\n\nAt PC = %x: %s\n\n", PC, Msg[n]);
      ERROR = TRUE;
+     LastError = n;
+     __sync_fetch_and_add(&Totals.Faults, 1);
 }
 
 /******************************************************************/
@@ -190,6 +466,32 @@ void PutMem (ADDRESS Addr, BYTE *Data, int Mode)
 
 /******************************************************************/
 
+void GetMemBlock (ADDRESS Addr, BYTE *Data, long Len)
+{
+  /* Copies Len bytes of memory starting at Addr into Data */
+
+     if (Len < 0 || Addr + Len > MSIZE) {
+         SICError(3);
+         return;
+     }
+     memcpy(Data, &Memory[Addr], Len);
+}
+
+/******************************************************************/
+
+void PutMemBlock (ADDRESS Addr, BYTE *Data, long Len)
+{
+  /* Copies Len bytes into memory starting at Addr */
+
+     if (Len < 0 || Addr + Len > MSIZE) {
+         SICError(3);
+         return;
+     }
+     memcpy(&Memory[Addr], Data, Len);
+}
+
+/******************************************************************/
+
 void GetReg (WORD *Regs)
 {
   int i, j;
@@ -304,6 +606,20 @@ char GetCC(void)
 
 /******************************************************************/
 
+void PutCC(char CC)
+{
+  /* Sets the condition code from '<', '=' or '>' (see GetCC) */
+
+     Status[2] &= 0x3f;
+     switch (CC) {
+         case '<': Status[2] |= (LT << 6); break;
+         case '=': Status[2] |= (EQ << 6); break;
+         case '>': Status[2] |= (GT << 6); break;
+     }
+}
+
+/******************************************************************/
+
 int SICEoln(FILE *f)
 {
   /* Check if at the end of line (or end of entire file). */
@@ -807,10 +1123,14 @@ void Logic(int opcode, WORD targaddr, BOOLEAN indir, BOOLEAN immed, WORD data,
 void CharIO(int opcode, WORD targaddr, BOOLEAN indir, BOOLEAN immed,
                WORD data, ADDRESS *opaddr)
 {
-  /* Handles the instructions  RD, WD, TD */
+  /* Handles the instructions  RD, WD, TD. A device with an attached
+     backend (see SICAttach) transfers bytes through it and has no
+     simulated latency; the others use the files named in SICFile.
+     The counter device is always ready. */
 
-  char c;
+  int b;
   int Devcode;            /* holds I/O device number */
+  SICDEVICE *d;
 
       GetData(opcode, targaddr, indir, immed, data, opaddr);
       if (immed)
@@ -822,84 +1142,689 @@ void CharIO(int opcode, WORD targaddr, BOOLEAN indir, BOOLEAN immed,
       Devcode--;                /* adjust for arrays starting at 0 */
 
       if (opcode == 224) {  /* TD */
-          if (Devcode >= 0 && Devcode < 6)
-              if (Wait[Devcode] == 0) {
+          if (Devcode == COUNTERS) {
+              Status[2] &= 0x3f;
+              Status[2] |= (LT << 6);
+          } else if (Devcode >= 0 && Devcode < 6) {
+              d = Backend[Devcode];
+              if (Wait[Devcode] == 0 && (d == NULL || d->Ready(d, Devcode > 2))) {
                   Status[2] &= 0x3f;
                   Status[2] |= (LT << 6);
                   Wait[Devcode] = ((Devcode + 1) & 3) + 2;
               } else {
                   Status[2] &= 0x3f;
                   Status[2] |= (EQ << 6);
-                  Wait[Devcode]--;
+                  if (Cooperative) {
+                      /* give up the host thread; the device gets ready
+                         while the other machines run */
+                      Wait[Devcode] = 0;
+                      Blocked = TRUE;
+                      BlockedOn = Devcode;
+                  } else if (Wait[Devcode] > 0)
+                      Wait[Devcode]--;
               }
-          else {
+          } else {
               SICError(9);  /* unsupported I/O device */
           }
       }
 
-      if (opcode == 216) {  /* RD */
+      if (opcode == 216 && Devcode == COUNTERS) {
+          Registers[0][2] = CounterGet();
+          __sync_fetch_and_add(&Totals.Counters, 1);
+      } else if (opcode == 216) {  /* RD */
           if (Devcode < 0 || Devcode > 2) {
               SICError(11);  /* device not available for read */
           } else {
               if (Wait[Devcode] != ((Devcode + 1) & 3) + 2) {
                   SICError(10);  /* device not ready for I/O*/
-              } else
+              } else if (Backend[Devcode] != NULL)
+                  Wait[Devcode] = 0;
+              else
                   Wait[Devcode]--;
           }
-          if (!ERROR)
-              if (!Init[Devcode]) {
-                  if ((Dev[Devcode] = fopen(SICFile[Devcode],"r")) == NULL) {
-                      printf("cannot open file %s\n", SICFile[Devcode]);
-                      exit(1);
-                  }
-                  Init[Devcode] = TRUE;
-              }
+          if (!ERROR) {
               if (EndFile[Devcode]) {
                   SICError(13);  /* attempt to read past end of file */
-              } else
-                  if (feof(Dev[Devcode])) {
-                      EndFile[Devcode] = TRUE;
-                      Registers[0][2] = 4;
-                  } else
-                      if (SICEoln(Dev[Devcode])) {
-                          Registers[0][2] = 0;
-                          fscanf(Dev[Devcode], "%*[^\n]");
-                          fgetc(Dev[Devcode]);
-                      } else {
-                          c = fgetc(Dev[Devcode]);
-                          if (c == '\n')
-                          c = ' ';
-                          Registers[0][2] = InTab[c];
-                      }
+              } else if ((b = DevGet(Devcode)) < 0)
+                  Registers[0][2] = 4;
+              else
+                  Registers[0][2] = b;
+          }
+          if (!ERROR)
+              __sync_fetch_and_add(&Totals.DevRead, 1);
       }
 
-      if (opcode == 220) {   /* WD */
+      if (opcode == 220 && Devcode == COUNTERS) {
+          if (Registers[0][2] == 0)
+              CounterMark();
+          else if (Registers[0][2] == 1)
+              CounterTake();
+          __sync_fetch_and_add(&Totals.Counters, 1);
+      } else if (opcode == 220) {   /* WD */
           if (Devcode < 3 || Devcode > 5) {
               SICError(12);  /* device not available for write */
           } else {
               if (Wait[Devcode] != ((Devcode + 1) & 3) + 2) {
                   SICError(10);  /* device not ready for I/O */
-              } else
+              } else if (Backend[Devcode] != NULL)
+                  Wait[Devcode] = 0;
+              else
                   Wait[Devcode]--;
           }
           if (!ERROR) {
-              if (!Init[Devcode]) {
-                  if ((Dev[Devcode] = fopen(SICFile[Devcode],"w")) == NULL) {
-                      printf("cannot open file %s\n", SICFile[Devcode]);
-                      exit(1);
-                  }
-                  Init[Devcode] = TRUE;
-              }
-              if (Registers[0][2] == 0)
-                  fputc('\n', Dev[Devcode]);
-              else
-                  fputc(OutTab[Registers[0][2]], Dev[Devcode]);
+              DevPut(Devcode, Registers[0][2]);
+              __sync_fetch_and_add(&Totals.DevWritten, 1);
           }
       }
 } /*CharIO*/
 
 /******************************************************************/
 
+int DevGet(int Devcode)
+{
+  /* Reads the next byte from input device Devcode (0 to 2): the byte,
+     0 at the end of a line, or -1 at the end of the file, which also
+     sets EndFile. The file of the device is opened on first use.
+     A file gives one more 0 when its data runs out, before -1; a
+     backend is made to do the same, so that a program sees the same
+     bytes from either. A file that cannot be opened is fault 11; -1
+     is returned without setting EndFile, so a later run tries again. */
+
+  char c;
+  int b;
+  SICDEVICE *d;
+
+     d = Backend[Devcode];
+     if (d != NULL) {
+         b = d->Read(d);
+         if (b < 0 && !EndLine[Devcode]) {
+             EndLine[Devcode] = TRUE;
+             b = 0;
+         }
+     } else {
+         if (!Init[Devcode]) {
+             if ((Dev[Devcode] = fopen(SICFile[Devcode],"r")) == NULL) {
+                 SICPrint("cannot open file %s\n", SICFile[Devcode]);
+                 SICError(11);  /* device not open for read */
+                 return -1;
+             }
+             Init[Devcode] = TRUE;
+         }
+         if (feof(Dev[Devcode]))
+             b = -1;
+         else
+             if (SICEoln(Dev[Devcode])) {
+                 b = 0;
+                 fscanf(Dev[Devcode], "%*[^\n]");
+                 fgetc(Dev[Devcode]);
+             } else {
+                 c = fgetc(Dev[Devcode]);
+                 if (c == '\n')
+                 c = ' ';
+                 b = InTab[c];
+             }
+     }
+     if (b < 0)
+         EndFile[Devcode] = TRUE;
+     return b;
+} /*DevGet*/
+
+/********************/
+
+void DevPut(int Devcode, BYTE b)
+{
+  /* Writes byte b to output device Devcode (3 to 5); 0 ends a line.
+     The file of the device is opened on first use; one that cannot be
+     opened is fault 12 and the byte is dropped. */
+
+  SICDEVICE *d;
+
+     d = Backend[Devcode];
+     if (d != NULL) {
+         d->Write(d, b);
+         return;
+     }
+     if (!Init[Devcode]) {
+         if ((Dev[Devcode] = fopen(SICFile[Devcode],"w")) == NULL) {
+             SICPrint("cannot open file %s\n", SICFile[Devcode]);
+             SICError(12);  /* device not open for write */
+             return;
+         }
+         Init[Devcode] = TRUE;
+     }
+     if (b == 0)
+         fputc('\n', Dev[Devcode]);
+     else
+         fputc(OutTab[b], Dev[Devcode]);
+} /*DevPut*/
+
+/******************************************************************/
+
+void CounterMark()
+{
+  /* Starts a region of the counter device: its numbers count from now */
+
+     MarkCount = ICount;
+     MarkCycles = Cycles;
+     clock_gettime(CLOCK_MONOTONIC, &MarkTime);
+     ReadNext = 0;
+     Taken = FALSE;
+} /*CounterMark*/
+
+/********************/
+
+void CounterTake()
+{
+  /* Takes a reading of the counter device: the instructions, cycles
+     and host nanoseconds since the mark, 6 bytes each, high byte first.
+     RD reads it from its first byte. */
+
+  struct timespec now;
+  unsigned long n[3];
+  int i, j;
+
+     clock_gettime(CLOCK_MONOTONIC, &now);
+     n[0] = ICount - MarkCount;
+     n[1] = Cycles - MarkCycles;
+     n[2] = (now.tv_sec - MarkTime.tv_sec) * 1000000000UL + now.tv_nsec - MarkTime.tv_nsec;
+     for (i = 0; i < 3; i++)
+         for (j = 0; j < 6; j++)
+             Reading[6 * i + j] = (n[i] >> (8 * (5 - j))) & 0xFF;
+     ReadNext = 0;
+     Taken = TRUE;
+} /*CounterTake*/
+
+/********************/
+
+int CounterGet()
+{
+  /* Returns the next byte of the reading of the counter device. The
+     first byte of a reading takes a new one, unless WD 1 just did. */
+
+  int b;
+
+     if (ReadNext == 0 && !Taken)
+         CounterTake();
+     Taken = FALSE;
+     b = Reading[ReadNext];
+     ReadNext = (ReadNext + 1) % 18;
+     return b;
+} /*CounterGet*/
+
+/******************************************************************/
+
+void Channel(int n)
+{
+  /* Runs the channel program of channel n, a list of 9 byte commands
+     starting at ChanProgram[n]:
+          byte 0       operation: 1 read, 2 write, 0 end of program
+          byte 1       device code (F1-F3 for read, 04-06 for write)
+          byte 2       not used
+          bytes 3-5    address of the record in memory
+          bytes 6-8    length of the record in bytes
+     Each command moves its whole record at once. A read stops early at
+     the end of the file, and a read or write on a backend stops early
+     when the backend is not ready; either way the number of bytes moved
+     is stored in bytes 6-8 and the program ends there (CH_SHORT), as
+     it does on a bad command. */
+
+  ADDRESS cmd, addr;
+  long len, i;
+  int op, Devcode, b;
+  SICDEVICE *d;
+
+     cmd = ChanProgram[n];
+     ChanState[n] = CH_SHORT;
+     while (cmd + 9 <= MSIZE) {
+         op = Memory[cmd];
+         if (op == 0) {
+             ChanState[n] = CH_DONE;
+             return;
+         }
+         Devcode = Memory[cmd + 1];
+         if (Devcode > 240)
+             Devcode -= 240;
+         Devcode--;
+         addr = (Memory[cmd + 3] << 16) | (Memory[cmd + 4] << 8) | Memory[cmd + 5];
+         len = (Memory[cmd + 6] << 16) | (Memory[cmd + 7] << 8) | Memory[cmd + 8];
+         if (addr + len > MSIZE)
+             return;
+         if (op == 1 && Devcode >= 0 && Devcode <= 2) {
+             d = Backend[Devcode];
+             for (i = 0; i < len && !EndFile[Devcode]; i++) {
+                 if (d != NULL && !d->Ready(d, FALSE))
+                     break;
+                 if ((b = DevGet(Devcode)) < 0)
+                     break;
+                 Memory[addr + i] = b;
+             }
+             __sync_fetch_and_add(&Totals.DevRead, i);
+         } else if (op == 2 && Devcode >= 3 && Devcode <= 5) {
+             d = Backend[Devcode];
+             for (i = 0; i < len; i++) {
+                 if (d != NULL && !d->Ready(d, TRUE))
+                     break;
+                 DevPut(Devcode, Memory[addr + i]);
+                 if (ERROR)
+                     break;
+             }
+             __sync_fetch_and_add(&Totals.DevWritten, i);
+         } else
+             return;                  /* bad operation or device */
+         if (i < len) {
+             Memory[cmd + 6] = (i >> 16) & 0xFF;
+             Memory[cmd + 7] = (i >> 8) & 0xFF;
+             Memory[cmd + 8] = i & 0xFF;
+             return;
+         }
+         cmd += 9;
+     }
+} /*Channel*/
+
+/********************/
+
+void ChanRun()
+{
+  /* Runs every channel program that was started and not yet run */
+
+  int n;
+
+     for (n = 0; n < CHANNELS; n++)
+         if (ChanState[n] == CH_PENDING)
+             Channel(n);
+     ChanPending = FALSE;
+} /*ChanRun*/
+
+/********************/
+
+void ChanIO(int opcode)
+{
+  /* Handles the instructions  SIO, TIO, HIO. The channel number is in
+     register A. SIO starts the channel program at the address in
+     register S (see Channel). The program runs when TIO tests its
+     channel, or at the latest at the end of the current budget of
+     instructions, so the CPU can go on computing in the meantime.
+     HIO halts a program that has not run yet. The condition code is
+          SIO   '<' started, '=' the channel is still busy
+          TIO   '<' the last program ended normally, '>' it ended early
+                or was halted, '=' no program was started
+          HIO   '<' a program was halted, '=' there was none */
+
+  long n;
+  int cc;
+
+     n = (Registers[0][0] << 16) | (Registers[0][1] << 8) | Registers[0][2];
+     if (n >= CHANNELS) {
+         SICError(14);  /* invalid channel */
+         return;
+     }
+     cc = EQ;
+     switch (opcode) {
+         case 240:                             /* SIO */
+                 if (ChanState[n] != CH_PENDING) {
+                     ChanProgram[n] = (Registers[4][0] << 16)
+                             | (Registers[4][1] << 8) | Registers[4][2];
+                     ChanState[n] = CH_PENDING;
+                     ChanPending = TRUE;
+                     cc = LT;
+                 }
+                 break;
+         case 244:                             /* HIO */
+                 if (ChanState[n] == CH_PENDING) {
+                     ChanState[n] = CH_SHORT;
+                     cc = LT;
+                 }
+                 break;
+         case 248:                             /* TIO */
+                 if (ChanState[n] == CH_PENDING)
+                     Channel(n);
+                 if (ChanState[n] == CH_DONE)
+                     cc = LT;
+                 else if (ChanState[n] == CH_SHORT)
+                     cc = GT;
+                 break;
+     }
+     Status[2] &= 0x3f;
+     Status[2] |= (cc << 6);
+} /*ChanIO*/
+
+/******************************************************************/
+
+void TestSet(WORD targaddr, BOOLEAN indir, BOOLEAN immed, ADDRESS *opaddr)
+{
+  /* Handles the instruction  TS. The byte at the operand address is set
+     to X'FF' in one atomic step, even if other CPUs share the memory.
+     CC is '=' if the byte was 0 (the lock was free), '>' otherwise. */
+
+  BYTE old;
+
+     if (immed) {
+         SICError(8);  /* immediate not allowed */
+     } else {
+         GetAddr(140, targaddr, indir, opaddr);
+         if (!ERROR) {
+             old = __atomic_exchange_n(&Memory[*opaddr], 0xFF, __ATOMIC_SEQ_CST);
+             Status[2] &= 0x3f;
+             Status[2] |= ((old == 0 ? EQ : GT) << 6);
+         }
+     }
+} /*TestSet*/
+
+/******************************************************************/
+
+double FGet(ADDRESS Addr)
+{
+  /* Returns the floating-point value at Addr: a sign bit, an 11 bit
+     exponent in excess 1024 and a 36 bit fraction with the binary
+     point at its left. Every such value is exact in a double. */
+
+  int exp;
+  double frac;
+
+     exp = ((Memory[Addr] & 0x7F) << 4) | (Memory[Addr + 1] >> 4);
+     frac = ((Memory[Addr + 1] & 0xF) * 4294967296.0)
+             + ((unsigned long) Memory[Addr + 2] << 24) + (Memory[Addr + 3] << 16)
+             + (Memory[Addr + 4] << 8) + Memory[Addr + 5];
+     frac = ldexp(frac, exp - 1024 - 36);
+     return (Memory[Addr] & 0x80) ? -frac : frac;
+} /*FGet*/
+
+/********************/
+
+void FPut(ADDRESS Addr, double Value)
+{
+  /* Stores Value at Addr in the format read by FGet, normalized and
+     rounded to the nearest 36 bit fraction. Values too small for the
+     exponent are stored as 0. */
+
+  int exp, i;
+  BYTE sign;
+  unsigned long long frac;
+
+     sign = Value < 0 ? 0x80 : 0;
+     frac = 0;
+     exp = 0;
+     if (Value != 0) {
+         frac = (unsigned long long) nearbyint(ldexp(frexp(fabs(Value), &exp), 36));
+         if (frac >> 36) {         /* rounded up to the next power of 2 */
+             frac >>= 1;
+             exp++;
+         }
+         exp += 1024;
+         if (exp > 2047) {
+             SICError(15);  /* floating-point overflow */
+             return;
+         }
+         if (exp < 0)
+             frac = exp = sign = 0;
+     }
+     Memory[Addr] = sign | (exp >> 4);
+     Memory[Addr + 1] = ((exp & 0xF) << 4) | (BYTE) (frac >> 32);
+     for (i = 2; i < 6; i++)
+         Memory[Addr + i] = (frac >> (8 * (5 - i))) & 0xFF;
+} /*FPut*/
+
+/********************/
+
+void FCheck()
+{
+  /* Faults if F is beyond the largest floating-point value */
+
+     if (!(fabs(Fl) < ldexp(1.0, 1023)))
+         SICError(15);  /* floating-point overflow */
+} /*FCheck*/
+
+/******************************************************************/
+
+void Float(int opcode, WORD targaddr, BOOLEAN indir, BOOLEAN immed,
+              ADDRESS *opaddr)
+{
+  /* Handles the instructions  ADDF, SUBF, MULF, DIVF, COMPF, LDF, STF.
+     The operand is the 6 byte floating-point value at the operand
+     address; immediate operands are not allowed. */
+
+  double op;
+
+     if (immed) {
+         SICError(8);  /* immediate not allowed */
+         return;
+     }
+     GetAddr(opcode, targaddr, indir, opaddr);
+     if (!ERROR && *opaddr > MSIZE - 6)
+         SICError(3);  /* address out of range */
+     if (ERROR)
+         return;
+     if (opcode == 128) {          /* STF */
+         FPut(*opaddr, Fl);
+         return;
+     }
+     op = FGet(*opaddr);
+     switch (opcode) {
+         case 112:                 /* LDF */
+                 Fl = op;
+                 break;
+         case 88:                  /* ADDF */
+                 Fl += op;
+                 break;
+         case 92:                  /* SUBF */
+                 Fl -= op;
+                 break;
+         case 96:                  /* MULF */
+                 Fl *= op;
+                 break;
+         case 100:                 /* DIVF */
+                 if (op == 0)
+                     SICError(1);  /* division by zero */
+                 else
+                     Fl /= op;
+                 break;
+         case 136:                 /* COMPF */
+                 Status[2] &= 0x3f;
+                 Status[2] |= ((Fl < op ? LT : Fl == op ? EQ : GT) << 6);
+                 break;
+     }
+     if (!ERROR)
+         FCheck();
+} /*Float*/
+
+/********************/
+
+void FloatReg(int opcode)
+{
+  /* Handles the instructions  FLOAT, FIX, NORM. FIX truncates toward
+     zero. F is always normalized, so NORM has nothing to do. */
+
+  long a;
+  double t;
+
+     switch (opcode) {
+         case 192:                 /* FLOAT */
+                 a = (Registers[0][0] << 16) | (Registers[0][1] << 8) | Registers[0][2];
+                 if (a & 0x800000)
+                     a -= 0x1000000;
+                 Fl = a;
+                 break;
+         case 196:                 /* FIX */
+                 t = trunc(Fl);
+                 if (t < -8388608.0 || t > 8388607.0) {
+                     SICError(2);  /* integer overflow */
+                     break;
+                 }
+                 a = (long) t & 0xFFFFFF;
+                 Registers[0][0] = a >> 16;
+                 Registers[0][1] = (a >> 8) & 0xFF;
+                 Registers[0][2] = a & 0xFF;
+                 break;
+         case 200:                 /* NORM */
+                 break;
+     }
+} /*FloatReg*/
+
+/******************************************************************/
+
+void Service(int n)
+{
+  /* Handles the instruction  SVC n by calling the host routine
+     registered for service n (see SICService). The routine works on
+     the memory and registers of the selected machine directly. An
+     error number it returns outside 1 to 15 has no message and is
+     reported as an unsupported instruction, like a missing service. */
+
+  int err;
+
+     if (SvcHandler[n] == NULL) {
+         SICError(5);  /* unsupported machine instruction */
+         return;
+     }
+     __sync_fetch_and_add(&Totals.Hypercalls[n], 1);
+     err = SvcHandler[n](SvcData[n]);
+     if (err < 0 || err > 15)
+         err = 5;
+     if (err != 0)
+         SICError(err);
+} /*Service*/
+
+/******************************************************************/
+
+BOOLEAN IsOp(ADDRESS Addr, int opcode, BOOLEAN index, ADDRESS *operand)
+{
+  /* TRUE if the instruction at Addr is opcode in SIC format, indexed
+     if index is TRUE; its address field is placed in 'operand' */
+
+     if (Memory[Addr] != opcode || ((Memory[Addr + 1] & 0x80) != 0) != index)
+         return FALSE;
+     *operand = ((Memory[Addr + 1] & 0x7F) << 8) | Memory[Addr + 2];
+     return TRUE;
+} /*IsOp*/
+
+/********************/
+
+BOOLEAN Idiom(unsigned long Room)
+{
+  /* Recognizes one of these loops at PC and runs all of its iterations
+     as one host operation, leaving memory, A, X, CC, PC and the
+     instruction count exactly as the loop would:
+          copy   LOOP LDCH src,X     fill  LOOP STCH dst,X
+                      STCH dst,X                TIX  len
+                      TIX  len                  JLT  LOOP
+                      JLT  LOOP
+          scan   LOOP LDCH src,X
+                      COMP c
+                      JEQ  found
+                      TIX  len
+                      JLT  LOOP
+     Copy is done with memmove, fill with memset and scan with memchr.
+     Returns FALSE, leaving the loop to run normally, if the loop is
+     not recognized, X is negative, an address would leave memory,
+     the loop would store into its own instructions or its limit len,
+     a copy would read bytes it has already stored (a forward copy onto
+     itself), or it would run more than Room instructions (0 means any
+     number). */
+
+  ADDRESS src, dst, len, c, found, target, end, s, d;
+  long x, n, count, i, per;
+  BYTE *p;
+  BYTE last;
+
+     src = dst = c = found = 0;
+     if (IsOp(PC, 80, TRUE, &src) && IsOp(PC + 3, 84, TRUE, &dst)
+             && IsOp(PC + 6, 44, FALSE, &len) && IsOp(PC + 9, 56, FALSE, &target)) {
+         per = 4;                   /* copy */
+     } else if (IsOp(PC, 84, TRUE, &dst) && IsOp(PC + 3, 44, FALSE, &len)
+             && IsOp(PC + 6, 56, FALSE, &target)) {
+         per = 3;                   /* fill */
+     } else if (IsOp(PC, 80, TRUE, &src) && IsOp(PC + 3, 40, FALSE, &c)
+             && IsOp(PC + 6, 48, FALSE, &found) && IsOp(PC + 9, 44, FALSE, &len)
+             && IsOp(PC + 12, 56, FALSE, &target)) {
+         per = 5;                   /* scan */
+     } else
+         return FALSE;
+     end = PC + 3 * per;
+     if (target != PC || len > MSIZE - 3 || c > MSIZE - 3)
+         return FALSE;
+
+     x = (Registers[1][0] << 16) | (Registers[1][1] << 8) | Registers[1][2];
+     n = (Memory[len] << 16) | (Memory[len + 1] << 8) | Memory[len + 2];
+     if (n & 0x800000)
+         n -= 0x1000000;
+     if (x >= MSIZE)                /* negative, or no address is valid */
+         return FALSE;
+     count = n > x + 1 ? n - x : 1;
+     if (Room != 0 && (unsigned long) (count * per) > Room)
+         return FALSE;
+     s = src + x;
+     d = dst + x;
+     if (per != 3 && s + count > MSIZE)
+         return FALSE;
+     if (per != 5) {
+         if (d + count > MSIZE
+                 || (d < end && d + count > PC) || (d < len + 3 && d + count > len))
+             return FALSE;
+         if (per == 4 && d > s && d < s + count)
+             return FALSE;
+     }
+
+     switch (per) {
+         case 4:
+                 last = Memory[s + count - 1];
+                 memmove(&Memory[d], &Memory[s], count);
+                 Registers[0][2] = last;
+                 break;
+         case 3:
+                 memset(&Memory[d], Registers[0][2], count);
+                 break;
+         case 5:
+                 p = NULL;
+                 if (Registers[0][0] == Memory[c] && Registers[0][1] == Memory[c + 1])
+                     p = memchr(&Memory[s], Memory[c + 2], count);
+                 if (p != NULL) {   /* left through JEQ at iteration i */
+                     i = p - &Memory[s];
+                     Registers[0][2] = Memory[c + 2];
+                     x += i;
+                     Registers[1][0] = x >> 16;
+                     Registers[1][1] = (x >> 8) & 0xFF;
+                     Registers[1][2] = x & 0xFF;
+                     Status[2] &= 0x3f;
+                     Status[2] |= (EQ << 6);
+                     Cycles += i * LoopCycles(PC, 5) + LoopCycles(PC, 3);
+                     PC = found;
+                     ICount += 5 * i + 3;
+                     __sync_fetch_and_add(&Totals.Idioms, 1);
+                     return TRUE;
+                 }
+                 Registers[0][2] = Memory[s + count - 1];
+                 break;
+     }
+     x += count;
+     Registers[1][0] = x >> 16;
+     Registers[1][1] = (x >> 8) & 0xFF;
+     Registers[1][2] = x & 0xFF;
+     Compl(Registers[1], &Memory[len]);
+     Cycles += count * LoopCycles(PC, per);
+     PC = end;
+     ICount += per * count;
+     __sync_fetch_and_add(&Totals.Idioms, 1);
+     return TRUE;
+} /*Idiom*/
+
+/******************************************************************/
+
+unsigned long LoopCycles(ADDRESS Addr, int n)
+{
+  /* The simulated cycles of the first n instructions at Addr, which
+     are all in SIC format (see Idiom) */
+
+  unsigned long c;
+  int i;
+
+     c = 0;
+     for (i = 0; i < n; i++)
+         c += 3 + OpBytes[Memory[Addr + 3 * i] >> 2];
+     return c;
+}
+
+/******************************************************************/
+
 void RegReg(int opcode, int reg1, int reg2)
 {
   /* Handles the instructions  ADDR, SUBR, MULR, DIVR, COMPR, TIXR */
@@ -924,8 +1849,8 @@ void RegReg(int opcode, int reg1, int reg2)
                        Compl(Registers[reg1],Registers[reg2]);
                        break;
               case 184:                           /* TIXR */
-                       Addl(Registers[0],Word1,Registers[0]);
-                       Compl(Registers[0],Registers[reg1]);
+                       Addl(Registers[1],Word1,Registers[1]);
+                       Compl(Registers[1],Registers[reg1]);
           } /*case*/
 } /*RegReg*/
 
@@ -1013,12 +1938,42 @@ void SICExec(int opcode, int reg1, int reg2, WORD targaddr, BOOLEAN indir,
                  Logic(opcode, targaddr, indir, immed, data, &opaddr);
                  break;
 
+         case 88:
+         case 92:
+         case 96:
+         case 100:
+         case 112:
+         case 128:
+         case 136:  /* ADDF, SUBF, MULF, DIVF, LDF, STF, COMPF */
+                 Float(opcode, targaddr, indir, immed, &opaddr);
+                 break;
+
+         case 192:
+         case 196:
+         case 200:  /* FLOAT, FIX, NORM */
+                 FloatReg(opcode);
+                 break;
+
+         case 176:  /* SVC */
+                 Service(reg1);
+                 break;
+
+         case 140:  /* TS */
+                 TestSet(targaddr, indir, immed, &opaddr);
+                 break;
+
          case 216:
          case 220:
          case 224:   /* RD, WD, TD*/
                  CharIO(opcode, targaddr, indir, immed, data, &opaddr);
                  break;
 
+         case 240:
+         case 244:
+         case 248:   /* SIO, HIO, TIO */
+                 ChanIO(opcode);
+                 break;
+
          case 144:
          case 148:
          case 152:
@@ -1054,7 +2009,7 @@ void SICStart()
 
      err1 = FALSE;
      if ((DevBoot = fopen("dev00","r")) == NULL) {
-         printf("cannot open boot file DEV00\n");
+         SICPrint("cannot open boot file DEV00\n");
          exit(1);
      }
      for (k = 0; k <= 3; k++) {
@@ -1215,7 +2170,7 @@ void DecAddr(WORD targaddr, BOOLEAN *immed, BOOLEAN *index, BOOLEAN *brel,
                      }
                      Addl(PCword, disp, targaddr);
                  } else
-                     for (i = 0; i <= 3; i++)
+                     for (i = 0; i < 3; i++)
                          targaddr[i] = disp[i];
          }
      }
@@ -1268,12 +2223,10 @@ void SICFetch(int *opcode, int *reg1, int *reg2, WORD targaddr, BOOLEAN *indir,
      err3 = FALSE;
      /* check for valid opcode */
      *opcode = (Memory[PC] / 4) * 4;
-     if (*opcode >= 88 && *opcode <= 100 || *opcode == 112
-             || *opcode == 128 || *opcode == 136 || *opcode == 176
-             || *opcode >= 192 && *opcode <= 200 || *opcode == 208
-             || *opcode == 212 || *opcode >= 228 && *opcode <= 248)
+     if (*opcode == 208
+             || *opcode == 212 || *opcode >= 228 && *opcode <= 236)
          err1 = TRUE;
-     if (*opcode == 140 || *opcode == 188 || *opcode == 204 || *opcode == 252)
+     if (*opcode == 188 || *opcode == 204 || *opcode == 252)
          err2 = TRUE;
      /* determine instruction format */
      if (*opcode <= 140 || *opcode >= 208 && *opcode <= 236)
@@ -1324,51 +2277,762 @@ void SICFetch(int *opcode, int *reg1, int *reg2, WORD targaddr, BOOLEAN *indir,
 
 /******************************************************************/
 
-void SICRun(ADDRESS *TempPC, BOOLEAN SingleStep)
+int SICLoop(BOOLEAN SingleStep, unsigned long Limit)
 {
   /* This procedure contains the main loop for simulating the execution
      of machine instructions. It calls the procedures 'SICFetch' and 'SICExec'
-     to fetch and execute each instruction in turn; it also checks for
-     breakpoints and instruction counts, issuing appropriate messages
-     to the user. */
-
-   int i;
-   BOOLEAN running;
+     to fetch and execute each instruction in turn, starting at the current
+     PC. It runs until an error, a stop request, a yield on a busy device
+     (cooperative machines only) or until Limit instructions have been
+     executed (0 means no limit). Returns why it ended. */
+
+   int i, budget;
+   unsigned long count;
+   ADDRESS start;
+   BOOLEAN running, locked;
+   int state;
    int opcode, reg1, reg2;                 /*current instruction*/
-   WORD disp, targaddr, addr;
-   BOOLEAN indir, immed, index, brel, PCrel, SICstd,
-           fmt1, fmt2, fmt3, fmt4;
+   WORD targaddr;
+   BOOLEAN indir, immed, index, brel, PCrel, SICstd;
 
      running = TRUE;
-     ERROR = FALSE;
-     if (*TempPC > MSIZE) {
-         SICError(3);      /* invalid address specified */
-     }
-     PC = *TempPC;
-     while (running && !ERROR) {
-         SICFetch(&opcode, &reg1, &reg2, targaddr, &indir, &immed, &index,
-                &brel, &PCrel, &SICstd);
-         if (!ERROR)
-             SICExec(opcode, reg1, reg2, targaddr, indir, immed);
-         if (SingleStep) {
+     state = SIC_PREEMPTED;
+     Stopped = FALSE;
+     Blocked = FALSE;
+     count = ICount;
+     while (running && !ERROR && !Blocked) {
+         /* the stop request is only polled between budgets so the
+            inner loop stays tight */
+         budget = BUDGET;
+         if (Limit != 0 && Limit - (ICount - count) < BUDGET)
+             budget = Limit - (ICount - count);
+         while (running && !ERROR && !Blocked && budget-- > 0) {
+             if (IDIOMS && !SingleStep && !Sharing && PC < MSIZE - 17
+                     && (Memory[PC] == 80 || Memory[PC] == 84)    /* LDCH, STCH */
+                     && Idiom(Limit == 0 ? 0 : Limit - (ICount - count)))
+                 continue;
+             start = PC;
+             locked = Sharing && Ordering == SIC_ORDER_SC;
+             if (locked)             /* the instruction runs as a whole */
+                 while (__atomic_exchange_n(Lock, 1, __ATOMIC_ACQUIRE))
+                     while (__atomic_load_n(Lock, __ATOMIC_RELAXED))
+                         ;
+             SICFetch(&opcode, &reg1, &reg2, targaddr, &indir, &immed, &index,
+                    &brel, &PCrel, &SICstd);
+             if (!ERROR) {
+                 /* the fetch has moved PC past the instruction */
+                 Cycles += PC - start + (immed ? 0 : OpBytes[opcode >> 2]);
+                 SICExec(opcode, reg1, reg2, targaddr, indir, immed);
+                 ICount++;
+             }
+             if (locked)
+                 __atomic_store_n(Lock, 0, __ATOMIC_RELEASE);
+             if (SingleStep) {
+                 running = FALSE;
+                 SICPrint("\nStepped to PC = %x\n", PC);
+             }
+         }
+         if (ChanPending)          /* the channels catch up with the CPU */
+             ChanRun();
+         if (__atomic_load_n(&RunState,__ATOMIC_RELAXED) == RUN_STOP
+             && running && !ERROR && !Blocked) {
+             Stopped = TRUE;      /* PC is at an instruction boundary */
+             state = SIC_STOPPED;
              running = FALSE;
-             printf("\nStepped to PC = %x\n", PC);
          }
+         if (Limit != 0 && ICount - count >= Limit)
+             running = FALSE;
      }
-     *TempPC = PC;
+     if (ERROR) {
+         state = SIC_FAULTED;
+         for (i = 3; i < 6; i++)   /* the program has ended, tell */
+             if (Backend[i] != NULL && Backend[i]->End != NULL)
+                 Backend[i]->End(Backend[i]);   /* its readers */
+     } else if (Blocked)
+         state = SIC_BLOCKED;
+     __sync_fetch_and_add(&Totals.Instructions, ICount - count);
+     return state;
+} /* SICLoop */
+
+/******************************************************************/
+
+void SICEnter(void)
+{
+  /* Marks a run as in progress. A stop request made while the run
+     was armed is kept, so SICLoop pauses at its first check, and so
+     is every run once SICStopAll was called. */
+
+  int run;
+
+     run = __atomic_load_n(&RunState,__ATOMIC_SEQ_CST);
+     while (run != RUN_STOP &&
+            !__atomic_compare_exchange_n(&RunState,&run,RUN_ACTIVE,FALSE,
+                                        __ATOMIC_SEQ_CST,__ATOMIC_SEQ_CST))
+         ;
+     if (__atomic_load_n(&Closing,__ATOMIC_SEQ_CST))   /* SICStopAll */
+         SICStop();                  /* may have missed this run */
+}
+
+/******************************************************************/
+
+void SICLeave(void)
+{
+  /* Ends the run, dropping a stop request it did not take. */
+
+     __atomic_store_n(&RunState,RUN_IDLE,__ATOMIC_RELEASE);
+}
+
+/******************************************************************/
+
+void SICRun(ADDRESS *TempPC, BOOLEAN SingleStep)
+{
+  /* Runs the selected machine from *TempPC until it stops;
+     *TempPC is set to the PC where it stopped. A cooperative
+     machine that yields is simply continued. */
+
+     ERROR = FALSE;
+     LastError = 0;
+     if (*TempPC > MSIZE) {
+         SICError(3);      /* invalid address specified */
+     }
+     PC = *TempPC;
+     SICEnter();
+     while (SICLoop(SingleStep, 0) == SIC_BLOCKED && !SingleStep)
+         ;
+     SICLeave();
+     *TempPC = PC;
 } /* SICRun */
 
 /******************************************************************/
 
+int SICSlice(unsigned long Limit)
+{
+  /* Continues the selected machine from its PC for at most Limit
+     instructions (0 means no limit). A scheduler calls this repeatedly:
+     SIC_BLOCKED and SIC_PREEMPTED mean the machine can be resumed
+     later with another call, SIC_FAULTED that it has ended and
+     SIC_STOPPED that it was paused by SICStop. */
+
+  int state;
+
+     ERROR = FALSE;
+     LastError = 0;
+     if (PC > MSIZE) {
+         SICError(3);      /* invalid address specified */
+         return SIC_FAULTED;
+     }
+     SICEnter();
+     state = SICLoop(FALSE, Limit);
+     SICLeave();
+     return state;
+} /* SICSlice */
+
+/******************************************************************/
+
+void SICCooperate(BOOLEAN On)
+{
+  /* In cooperative mode the selected machine yields (SICSlice returns
+     SIC_BLOCKED) when TD finds a device busy, instead of spinning in
+     its polling loop. Its state stays in the machine, so it is
+     resumed by calling SICSlice again. */
+
+     Cooperative = On;
+     Blocked = FALSE;
+}
+
+/******************************************************************/
+
+BOOLEAN SICWaiting()
+{
+  /* TRUE if the selected machine yielded on a busy device (SIC_BLOCKED)
+     that is still busy: a backend that is not ready, such as a pipe
+     nobody has written to. A device file is only busy for a few polls,
+     so it is ready by the time the machine is resumed. A scheduler can
+     leave a waiting machine aside until this turns FALSE. */
+
+  SICDEVICE *d;
+
+     if (!Blocked)
+         return FALSE;
+     d = Backend[BlockedOn];
+     return d != NULL && !d->Ready(d, BlockedOn > 2);
+}
+
+/******************************************************************/
+
+void SICAttach(int Devcode, SICDEVICE *Device)
+{
+  /* Connects device Devcode (0 to 5, as in Dev) of the selected machine
+     to a backend, or back to its file in SICFile if Device is NULL.
+     Input devices read from Device->Read and output devices write to
+     Device->Write. TD reports the device busy while Device->Ready is
+     FALSE. The backend belongs to the caller. */
+
+     if (Devcode < 0 || Devcode > 5)
+         return;
+     if (Init[Devcode] && Dev[Devcode] != NULL)
+         fclose(Dev[Devcode]);
+     Dev[Devcode] = NULL;
+     Init[Devcode] = FALSE;
+     EndFile[Devcode] = FALSE;
+     EndLine[Devcode] = FALSE;
+     Wait[Devcode] = 0;
+     Backend[Devcode] = Device;
+} /* SICAttach */
+
+/******************************************************************/
+
+int SICCharIO(int Opcode, BYTE Device, WORD A)
+{
+  /* Executes RD, WD or TD (Opcode) on the device with code Device of
+     the selected machine, using A in place of register A. A and the
+     condition code are updated. This is for callers that keep the
+     registers of the machine elsewhere, such as the lockstep engine.
+     Returns the error number, 0 if none. */
+
+  int i;
+  WORD targaddr, data;
+  ADDRESS opaddr;
+
+     ERROR = FALSE;
+     LastError = 0;
+     targaddr[0] = 0;
+     targaddr[1] = 0;
+     targaddr[2] = Device;
+     for (i = 0; i < 3; i++)
+         Registers[0][i] = A[i];
+     CharIO(Opcode, targaddr, FALSE, TRUE, data, &opaddr);
+     for (i = 0; i < 3; i++)
+         A[i] = Registers[0][i];
+     return LastError;
+} /* SICCharIO */
+
+/******************************************************************/
+
+void SICAddCount(unsigned long Count)
+{
+  /* Adds instructions executed outside of SICRun to the counts */
+
+     ICount += Count;
+     __sync_fetch_and_add(&Totals.Instructions, Count);
+}
+
+/******************************************************************/
+
+void SICAddCycles(unsigned long Count)
+{
+  /* Adds the simulated cycles of instructions executed outside of
+     SICRun, as SICOpCycles gives them */
+
+     Cycles += Count;
+}
+
+/******************************************************************/
+
+int SICOpCycles(int Opcode)
+{
+  /* The simulated cycles of a format 3 instruction with Opcode and a
+     memory operand, as SICLoop counts them: its 3 bytes and the bytes
+     of memory it reads or writes */
+
+     return 3 + OpBytes[(Opcode & 0xFC) >> 2];
+}
+
+/******************************************************************/
+
+int SICFault(void)
+{
+  /* Returns the error number of the fault that stopped the last
+     call to SICRun, or 0 if it stopped normally. */
+
+     return LastError;
+}
+
+/******************************************************************/
+
+void SICStop(void)
+{
+  /* Asks a run in progress to pause at the next budget boundary.
+     Safe to call from another thread or from a signal handler.
+     A request made while no run is armed or in progress is dropped,
+     so it can never pause a later run. */
+
+  int run;
+
+     run = __atomic_load_n(&RunState,__ATOMIC_SEQ_CST);
+     while ((run == RUN_ARMED || run == RUN_ACTIVE) &&
+            !__atomic_compare_exchange_n(&RunState,&run,RUN_STOP,FALSE,
+                                        __ATOMIC_SEQ_CST,__ATOMIC_SEQ_CST))
+         ;
+}
+
+/******************************************************************/
+
+void SICArm(void)
+{
+  /* Marks a run of the selected machine as about to start, so that a
+     SICStop made before it gets going still pauses it. Only call this
+     right before a SICRun (usually on another thread) that is sure to
+     follow; the run clears it when it ends. */
+
+  int run;
+
+     run = RUN_IDLE;
+     __atomic_compare_exchange_n(&RunState,&run,RUN_ARMED,FALSE,
+                                 __ATOMIC_ACQ_REL,__ATOMIC_ACQUIRE);
+}
+
+/******************************************************************/
+
+BOOLEAN SICStopped(void)
+{
+  /* TRUE if the last run was paused by SICStop. The run can be
+     continued by calling SICRun with the current PC. */
+
+     return Stopped;
+}
+
+/******************************************************************/
+
+BOOLEAN SICRunning(void)
+{
+     return __atomic_load_n(&RunState,__ATOMIC_ACQUIRE) != RUN_IDLE;
+}
+
+/******************************************************************/
+
+unsigned long SICCount(void)
+{
+  /* Returns the number of instructions executed */
+
+     return ICount;
+}
+
+/******************************************************************/
+
+void SICClearCount(void)
+{
+  /* Clears the instruction and cycle counts, which also starts a
+     region of the counter device */
+
+     ICount = 0;
+     Cycles = 0;
+     CounterMark();
+}
+
+/******************************************************************/
+
+unsigned long SICCycles(void)
+{
+  /* Returns the number of simulated cycles, counted like ICount */
+
+     return Cycles;
+}
+
+/******************************************************************/
+
+void SICReset()
+{
+  /* Sets the selected machine to its power-on state */
+
+  long loc;
+
+     for (loc = 0; loc < MSIZE; loc++) /* initialize memory to hex 'ff' */
+         Memory[loc] = 255;
+     SICResetCPU();
+} /* SICReset */
+
+/******************************************************************/
+
+void SICResetCPU()
+{
+  /* Sets the CPU and the devices of the selected machine to their
+     power-on state. Memory is left alone. */
+
+  int i, j;
+
+     for (i = 0; i < 6; i++) {      /* set up I/O device status */
+         Init[i] = FALSE;
+         Wait[i] = 0;
+         EndFile[i] = FALSE;
+         EndLine[i] = FALSE;
+     }
+     for (i = 0; i < CHANNELS; i++) /* no channel programs */
+         ChanState[i] = CH_IDLE;
+     ChanPending = FALSE;
+     for (i = 0; i < 6; i++)        /* initialize registers to hex 'ff' */
+         for (j = 0; j < 3; j++)
+             Registers[i][j] = 255;
+     PC = 0;
+     for (i = 0; i < 3; i++)        /* initialize status word */
+         Status[i] = 0;
+     Fl = 0;
+     ERROR = FALSE;
+     LastError = 0;
+     ICount = 0;
+     Stopped = FALSE;
+     RunState = RUN_IDLE;
+     Blocked = FALSE;
+     Cycles = 0;
+     CounterMark();
+} /* SICResetCPU */
+
+/******************************************************************/
+
+SICMACHINE *SICNew()
+{
+  /* Creates a machine in its power-on state. The selected machine
+     does not change. */
+
+  SICMACHINE *m, *prev;
+  BYTE *mem;
+
+     m = calloc(1, sizeof(SICMACHINE));
+     mem = malloc(MSIZE);
+     if (m == NULL || mem == NULL) {
+         printf("cannot allocate SIC machine\n");
+         exit(1);
+     }
+     prev = Mach;
+     Mach = m;
+     Memory = mem;
+     Lock = &m->MemoryLock;
+     SICReset();
+     Mach = prev;
+     ListAdd(m);
+     return m;
+} /* SICNew */
+
+/******************************************************************/
+
+void SICFree(SICMACHINE *m)
+{
+  /* Releases a machine along with its open devices. The selected
+     machine cannot be freed. */
+
+  int i;
+  SICMACHINE *prev;
+
+     if (m == NULL || m == Mach)
+         return;
+     prev = Mach;
+     Mach = m;
+     for (i = 0; i < 6; i++)
+         if (Init[i] && Dev[i] != NULL)
+             fclose(Dev[i]);
+     if (!SharedMemory)
+         free(Memory);
+     Mach = prev;
+     ListRemove(m);
+     free(m);
+} /* SICFree */
+
+/******************************************************************/
+
+void ListAdd(SICMACHINE *m)
+{
+  /* Puts a new machine on the list of all machines. */
+
+     while (__atomic_exchange_n(&ListLock,1,__ATOMIC_ACQUIRE))
+         ;
+     m->ListPrev = NULL;
+     m->ListNext = AllMachines;
+     if (AllMachines != NULL)
+         AllMachines->ListPrev = m;
+     AllMachines = m;
+     __atomic_store_n(&ListLock,0,__ATOMIC_RELEASE);
+}
+
+/******************************************************************/
+
+void ListRemove(SICMACHINE *m)
+{
+  /* Takes a machine that is being freed off the list. */
+
+     while (__atomic_exchange_n(&ListLock,1,__ATOMIC_ACQUIRE))
+         ;
+     if (m->ListPrev != NULL)
+         m->ListPrev->ListNext = m->ListNext;
+     else if (AllMachines == m)
+         AllMachines = m->ListNext;
+     if (m->ListNext != NULL)
+         m->ListNext->ListPrev = m->ListPrev;
+     __atomic_store_n(&ListLock,0,__ATOMIC_RELEASE);
+}
+
+/******************************************************************/
+
+SICMACHINE *SICNewShared(SICMACHINE *m)
+{
+  /* Creates another CPU for the memory of machine m. It has its own
+     registers, status word and devices, and starts in the power-on
+     state with memory sequentially consistent (see SICOrdering).
+     m must outlive it. The selected machine does not change. */
+
+  SICMACHINE *cpu, *prev;
+  BYTE *mem;
+
+     cpu = calloc(1, sizeof(SICMACHINE));
+     if (cpu == NULL) {
+         printf("cannot allocate SIC machine\n");
+         exit(1);
+     }
+     prev = Mach;
+     Mach = m;
+     mem = Memory;
+     Mach = cpu;
+     Memory = mem;
+     Lock = &m->MemoryLock;
+     SharedMemory = TRUE;
+     Sharing = TRUE;
+     SICResetCPU();
+     Mach = prev;
+     ListAdd(cpu);
+     return cpu;
+} /* SICNewShared */
+
+/******************************************************************/
+
+void SICOrdering(int Order)
+{
+  /* Sets how the memory accesses of the selected CPU are seen by the
+     other CPUs sharing its memory. SIC_ORDER_SC (the default) runs
+     every instruction as a whole under the lock of the memory, so the
+     CPUs see each other's instructions one at a time and never a half
+     written word. SIC_ORDER_RELAXED takes no lock and is faster, but
+     only single bytes are accessed as a unit, in the order of the
+     host; words need a TS lock around them. Machines that do not
+     share memory are not affected. */
+
+     Ordering = Order;
+}
+
+/******************************************************************/
+
+void SICSharing(BOOLEAN On)
+{
+  /* Tells the selected machine whether other CPUs run on its memory,
+     for the machine that owns the memory while CPUs made with
+     SICNewShared run on it (those are always sharing). A sharing CPU
+     follows its ordering (see SICOrdering) and runs every instruction
+     on its own, without the faster sequences that skip the memory
+     accesses of a loop. */
+
+     Sharing = On;
+}
+
+/******************************************************************/
+
+void SICStopMachine(SICMACHINE *m)
+{
+  /* SICStop for a machine that may be running on another thread.
+     Safe to call from a signal handler. */
+
+  SICMACHINE *prev;
+
+     if (m == NULL)
+         return;
+     prev = Mach;
+     Mach = m;
+     SICStop();
+     Mach = prev;
+}
+
+/******************************************************************/
+
+void SICStopAll(void)
+{
+  /* Pauses the runs of every machine, on whatever thread they are,
+     and every run started from now on as soon as it starts. For a
+     process that is shutting down; not for a signal handler, since
+     it waits for machines being created or freed. */
+
+  SICMACHINE *m;
+
+     __atomic_store_n(&Closing,TRUE,__ATOMIC_SEQ_CST);
+     while (__atomic_exchange_n(&ListLock,1,__ATOMIC_ACQUIRE))
+         ;
+     for (m = AllMachines; m != NULL; m = m->ListNext)
+         SICStopMachine(m);
+     __atomic_store_n(&ListLock,0,__ATOMIC_RELEASE);
+}
+
+/******************************************************************/
+
+BOOLEAN SICClosing(void)
+{
+  /* TRUE once SICStopAll was called, for hosts that run machines
+     in a loop of their own (see lockstep.h). */
+
+     return __atomic_load_n(&Closing,__ATOMIC_RELAXED);
+}
+
+/******************************************************************/
+
+void SICSelect(SICMACHINE *m)
+{
+  /* Makes m the machine that every other routine operates on */
+
+     if (m != NULL)
+         Mach = m;
+}
+
+/******************************************************************/
+
+SICMACHINE *SICCurrent()
+{
+     return Mach;
+}
+
+/******************************************************************/
+
+void SICGetStats(SICSTATS *Stats)
+{
+  /* Copies the totals of all machines since SICInit */
+
+     *Stats = Totals;
+}
+
+/******************************************************************/
+
+void SICService(int N, SICSERVICE Handler, void *Data)
+{
+  /* Registers Handler as service N (0 to 15) for the instruction SVC N
+     of every machine, or removes the service if Handler is NULL. It is
+     called with Data on the thread running the machine, which is the
+     selected one. It returns an error number (1 to 15, see Msg), 0 if
+     none. */
+
+     if (N < 0 || N > 15)
+         return;
+     SvcHandler[N] = Handler;
+     SvcData[N] = Data;
+}
+
+/******************************************************************/
+
+void SICPrinter(SICPRINT Routine)
+{
+  /* Sends the messages of the engine (faults, single steps) to Routine
+     instead of the standard output, or back to it if Routine is NULL.
+     Routine is called on the thread running the machine. */
+
+     Printer = Routine;
+}
+
+/******************************************************************/
+
+BYTE *SICMemory()
+{
+  /* The MSIZE bytes of memory of the selected machine */
+
+     return Memory;
+}
+
+/******************************************************************/
+
+WORD *SICRegisters()
+{
+  /* The registers A, X, L, B, S, T of the selected machine */
+
+     return Registers;
+}
+
+/******************************************************************/
+
+void SICGetState(SICSTATE *State)
+{
+  /* Copies what the selected machine holds besides its memory,
+     registers and PC. The output files are flushed first, so that
+     the file of each device holds everything written to it. */
+
+  int i;
+
+     for (i = 0; i < 3; i++)
+         State->SW[i] = Status[i];
+     State->F = Fl;
+     State->Fault = LastError;
+     State->Clock = Cycles;
+     State->Attached = FALSE;
+     for (i = 0; i < 6; i++) {
+         State->Position[i] = -1;
+         State->AtEnd[i] = FALSE;
+         if (Backend[i] != NULL)
+             State->Attached = TRUE;
+         else if (Init[i] && Dev[i] != NULL) {
+             if (i > 2)
+                 fflush(Dev[i]);
+             State->Position[i] = ftell(Dev[i]);
+             State->AtEnd[i] = feof(Dev[i]) != 0;
+         }
+         State->EndRead[i] = EndFile[i];
+         State->Countdown[i] = Wait[i];
+     }
+     State->Channels = FALSE;
+     for (i = 0; i < CHANNELS; i++)
+         if (ChanState[i] != CH_IDLE)
+             State->Channels = TRUE;
+} /* SICGetState */
+
+/******************************************************************/
+
+void SICSetState(SICSTATE *State)
+{
+  /* Gives the selected machine a state from SICGetState, as at the
+     end of a run (not paused) that is not executed again. The file of each device
+     without a backend is opened again at its position; an output file
+     must already hold what was written before it. Backends and
+     channels are left alone. */
+
+  int i;
+
+     for (i = 0; i < 3; i++)
+         Status[i] = State->SW[i];
+     Fl = State->F;
+     LastError = State->Fault;
+     Cycles = State->Clock;
+     Stopped = FALSE;
+     for (i = 0; i < 6; i++) {
+         if (Backend[i] != NULL)
+             continue;
+         if (Init[i] && Dev[i] != NULL)
+             fclose(Dev[i]);
+         Dev[i] = NULL;
+         Init[i] = FALSE;
+         if (State->Position[i] >= 0
+                 && (Dev[i] = fopen(SICFile[i], i > 2 ? "r+" : "r")) != NULL) {
+             Init[i] = TRUE;
+             fseek(Dev[i], State->Position[i], SEEK_SET);
+             if (State->AtEnd[i])
+                 fgetc(Dev[i]);      /* sets the end of file again */
+         }
+         EndFile[i] = State->EndRead[i];
+         Wait[i] = State->Countdown[i];
+     }
+} /* SICSetState */
+
+/******************************************************************/
+
+char *SICMessage(int n)
+{
+  /* The message of error number n, as SICError prints it */
+
+     if (n < 0 || n > 15)
+         return Msg[0];
+     return Msg[n];
+}
+
+/******************************************************************/
+
 void SICInit()
 {
   /* This procedure is called at the beginning of the simulation
      to set up initial values. InTab and OutTab are set to reflect
      the character collating sequence of the host machine (see notes
-     on installing the simulator). */
+     on installing the simulator). It also creates the first machine
+     and selects it. */
 
-  int i, j;
-  long loc;
+  int i;
 
 #if 0
      if ((Log = fopen("log","w")) == NULL) {
@@ -1382,22 +3046,10 @@ void SICInit()
      for (i = 0; i <= 255; i++)
          OutTab[InTab[i]] = i;
 
-     for (i = 0; i < 6; i++) {      /* set up I/O device status */
-         Init[i] = FALSE;
-         Wait[i] = 0;
-         EndFile[i] = FALSE;
-     }
      Word1[0] = 0;                  /* define a word containing value 1 */
      Word1[1] = 0;
      Word1[2] = 1;
-     for (loc = 0; loc < MSIZE; loc++) /* initialize memory to hex 'ff' */
-         Memory[loc] = 255;
-     for (i = 0; i < 6; i++)        /* initialize registers to hex 'ff' */
-         for (j = 0; j < 3; j++)
-             Registers[i][j] = 255;
-     PC = 0;
-     for (i = 0; i < 3; i++)        /* initialize status word */
-         Status[i] = 0;
+     Mach = SICNew();
      Msg[0] = strdup(" ");
      Msg[1] = strdup("Division by zero");
      Msg[2] = strdup("Integer overflow");
@@ -1412,6 +3064,6 @@ void SICInit()
      Msg[11] = strdup("Device not open for read");
      Msg[12] = strdup("Device not open for write");
      Msg[13] = strdup("End of file reached");
-     for (i = 14; i < 16; i++)
-         Msg[i] = strdup(" ");
+     Msg[14] = strdup("Invalid channel");
+     Msg[15] = strdup("Floating-point overflow");
 } /* SICInit */
@@ -1,23 +1,111 @@
 
+#ifndef SICENGINE_H
+#define SICENGINE_H
+
                 /* Define a few constants */
 #define TRUE    1                       /* Boolean constants */
 #define FALSE   0
 #define MSIZE   32768L
 
+                /* Why SICSlice returned */
+#define SIC_FAULTED     0               /* stopped by an error */
+#define SIC_STOPPED     1               /* paused by SICStop */
+#define SIC_BLOCKED     2               /* yielded on a busy device */
+#define SIC_PREEMPTED   3               /* used up its instruction limit */
+
+                /* Memory ordering between CPUs sharing memory */
+#define SIC_ORDER_SC    0               /* sequentially consistent */
+#define SIC_ORDER_RELAXED 1             /* whatever the host does */
+
                 /* Define some useful data types */
 typedef unsigned char   BYTE;
 typedef BYTE            WORD[3];
 typedef BYTE            FLOAT[4];
 typedef unsigned char   BOOLEAN;
 typedef unsigned long   ADDRESS;
+typedef struct SICMachine SICMACHINE;   /* state of one machine (opaque) */
+typedef struct SICDevice SICDEVICE;
+struct SICDevice {                      /* backend of an I/O device */
+        BOOLEAN (*Ready)(SICDEVICE *, BOOLEAN); /* can a byte be read (or */
+                                                /*  written if TRUE) now */
+        int (*Read)(SICDEVICE *);               /* next byte, -1 at the end */
+        void (*Write)(SICDEVICE *, BYTE);
+        void (*End)(SICDEVICE *);               /* the writer has stopped */
+        void *Data;                             /* state of the backend */
+     };
+typedef struct {
+        unsigned long Instructions;     /* instructions executed */
+        unsigned long DevRead;          /* bytes read by RD */
+        unsigned long DevWritten;       /* bytes written by WD */
+        unsigned long Faults;           /* runs stopped by an error */
+        unsigned long Hypercalls[16];   /* SVC calls per service number */
+        unsigned long Idioms;           /* loops run as one host operation */
+        unsigned long Counters;         /* RD and WD on the counter device */
+     } SICSTATS;
+typedef struct {                        /* what a machine holds besides */
+                                        /*  its memory, registers and PC */
+        WORD SW;                        /* status word */
+        double F;                       /* floating point register */
+        int Fault;                      /* error number of the last run */
+        unsigned long Clock;            /* simulated cycles (SICCycles) */
+        long Position[6];               /* offset in the file of each */
+                                        /*  device, -1 if it is not open */
+        BOOLEAN AtEnd[6];               /* its file has been read to the end */
+        BOOLEAN EndRead[6];             /* RD has reported the end */
+        BYTE Countdown[6];              /* TD countdown of each device */
+        BOOLEAN Attached;               /* some device has a backend */
+        BOOLEAN Channels;               /* some channel has a program */
+     } SICSTATE;
+typedef int (*SICSERVICE)(void *);      /* host routine for SVC n, returns */
+                                        /*  an error number, 0 if none */
+typedef void (*SICPRINT)(const char *); /* receives a message of the engine */
 
 extern void GetMem (ADDRESS, BYTE*, int);
 extern void PutMem (ADDRESS, BYTE*, int);
+extern void PutMemBlock (ADDRESS, BYTE*, long);
+extern void GetMemBlock (ADDRESS, BYTE*, long);
 extern void GetReg (WORD*);
 extern void PutReg (WORD*);
 extern ADDRESS GetPC (void);
 extern void GetIR (ADDRESS, char *);
 extern char GetCC (void);
+extern void PutCC (char);
 extern void PutPC (ADDRESS);
 extern void SICInit (void);
 extern void SICRun (ADDRESS *, BOOLEAN);
+extern int SICSlice (unsigned long);
+extern void SICCooperate (BOOLEAN);
+extern BOOLEAN SICWaiting (void);
+extern void SICAttach (int, SICDEVICE *);
+extern int SICCharIO (int, BYTE, WORD);
+extern void SICAddCount (unsigned long);
+extern void SICAddCycles (unsigned long);
+extern int SICOpCycles (int);
+extern int SICFault (void);
+extern void SICStop (void);
+extern void SICArm (void);
+extern BOOLEAN SICStopped (void);
+extern BOOLEAN SICRunning (void);
+extern unsigned long SICCount (void);
+extern void SICClearCount (void);
+extern SICMACHINE *SICNew (void);
+extern void SICFree (SICMACHINE *);
+extern SICMACHINE *SICNewShared (SICMACHINE *);
+extern void SICOrdering (int);
+extern void SICSharing (BOOLEAN);
+extern void SICStopMachine (SICMACHINE *);
+extern void SICStopAll (void);
+extern BOOLEAN SICClosing (void);
+extern void SICSelect (SICMACHINE *);
+extern SICMACHINE *SICCurrent (void);
+extern void SICGetStats (SICSTATS *);
+extern void SICService (int, SICSERVICE, void *);
+extern BYTE *SICMemory (void);
+extern WORD *SICRegisters (void);
+extern unsigned long SICCycles (void);
+extern void SICGetState (SICSTATE *);
+extern void SICSetState (SICSTATE *);
+extern char *SICMessage (int);
+extern void SICPrinter (SICPRINT);
+
+#endif
@@ -0,0 +1,154 @@
+
+/*
+    Counters and timings for the "stats" command.
+
+    The interpreter commands add to these as they go: the assembler
+    stages, the loader and the machine runs. The engine keeps its own
+    totals (instructions, device bytes, faults, SVC calls) which are read
+    with SICGetStats when the stats are displayed.
+*/
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <chrono>
+#include <iomanip>
+#include "util.h"
+#include "services.h"
+
+extern "C"{
+    #include "sicengine.h"
+}
+
+//Measures the time since it was created
+class Timer{
+    private:
+        std::chrono::steady_clock::time_point started;
+
+    public:
+        Timer() : started(std::chrono::steady_clock::now()){}
+
+        double seconds() const{
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        }
+};
+
+//Cumulative time and number of times for a stage
+struct Stage{
+    unsigned long count;
+    double seconds;
+
+    Stage() : count(0), seconds(0){}
+
+    void add(double elapsed){
+        count++;
+        seconds += elapsed;
+    }
+};
+
+class Stats{
+    public:
+        //assembler
+        unsigned long linesAssembled;
+        unsigned long symbols;
+        unsigned long recordsWritten;
+        unsigned long cacheHits;
+        unsigned long cacheMisses;
+
+        //runs through the run cache (execute --memo)
+        unsigned long runsReplayed;
+        unsigned long runsStored;
+
+        //loader
+        unsigned long bytesLoaded;
+
+        Stage pass1;
+        Stage pass2;
+        Stage cache;        //assemblies answered from the cache
+        Stage load;
+        Stage run;
+
+        Stats() : linesAssembled(0), symbols(0), recordsWritten(0), cacheHits(0), cacheMisses(0),
+            runsReplayed(0), runsStored(0), bytesLoaded(0){}
+
+        void display(bool json) const{
+            SICSTATS engine;
+            SICGetStats(&engine);
+
+            if(json){
+                cout << "{\"lines_assembled\":" << linesAssembled;
+                cout << ",\"symbols\":" << symbols;
+                cout << ",\"records_written\":" << recordsWritten;
+                cout << ",\"cache_hits\":" << cacheHits;
+                cout << ",\"cache_misses\":" << cacheMisses;
+                cout << ",\"runs_replayed\":" << runsReplayed;
+                cout << ",\"runs_stored\":" << runsStored;
+                cout << ",\"bytes_loaded\":" << bytesLoaded;
+                cout << ",\"instructions_executed\":" << engine.Instructions;
+                cout << ",\"device_bytes_read\":" << engine.DevRead;
+                cout << ",\"device_bytes_written\":" << engine.DevWritten;
+                cout << ",\"faults\":" << engine.Faults;
+                cout << ",\"loops_fused\":" << engine.Idioms;
+                cout << ",\"hypercalls\":[";
+                for(int n = 0; n < 16; n++)
+                    cout << (n ? "," : "") << engine.Hypercalls[n];
+                cout << "]";
+                cout << ",\"stages\":{";
+                displayJson("pass1", pass1);
+                cout << ",";
+                displayJson("pass2", pass2);
+                cout << ",";
+                displayJson("cache", cache);
+                cout << ",";
+                displayJson("load", load);
+                cout << ",";
+                displayJson("run", run);
+                cout << "}}\n";
+                return;
+            }
+
+            cout << "Lines assembled:       " << linesAssembled << "\n";
+            cout << "Symbols:               " << symbols << "\n";
+            cout << "Records written:       " << recordsWritten << "\n";
+            cout << "Cache hits/misses:     " << cacheHits << "/" << cacheMisses << "\n";
+            cout << "Runs replayed/stored:  " << runsReplayed << "/" << runsStored << "\n";
+            cout << "Bytes loaded:          " << bytesLoaded << "\n";
+            cout << "Instructions executed: " << engine.Instructions << "\n";
+            cout << "Device bytes read:     " << engine.DevRead << "\n";
+            cout << "Device bytes written:  " << engine.DevWritten << "\n";
+            cout << "Faults:                " << engine.Faults << "\n";
+            cout << "Loops fused:           " << engine.Idioms << "\n";
+            unsigned long hypercalls = 0;
+            for(int n = 0; n < 16; n++)
+                hypercalls += engine.Hypercalls[n];
+            cout << "Hypercalls (SVC):      " << hypercalls << "\n";
+            for(int n = 0; n < 16; n++)
+                if(engine.Hypercalls[n] != 0){
+                    string label = "  SVC " + std::to_string(n) + " " + Services::name(n);
+                    cout << std::left << std::setw(23) << std::setfill(' ') << label << std::right;
+                    cout << engine.Hypercalls[n] << "\n";
+                }
+            cout << "\nStage   Count   Seconds\n";
+            displayStage("pass1", pass1);
+            displayStage("pass2", pass2);
+            displayStage("cache", cache);
+            displayStage("load", load);
+            displayStage("run", run);
+        }
+
+    private:
+        void displayStage(const char* name, const Stage& stage) const{
+            cout << std::left << std::setw(8) << std::setfill(' ') << name << std::right;
+            cout << std::setw(5) << stage.count << "   ";
+            cout << std::fixed << std::setprecision(6) << stage.seconds << "\n";
+            cout.unsetf(std::ios::floatfield);
+        }
+
+        void displayJson(const char* name, const Stage& stage) const{
+            cout << "\"" << name << "\":{\"count\":" << stage.count;
+            cout << ",\"seconds\":" << std::fixed << std::setprecision(6) << stage.seconds << "}";
+            cout.unsetf(std::ios::floatfield);
+        }
+};
+
+#endif
@@ -0,0 +1,92 @@
+/*
+    Benchmark of Codec::parseInt and Codec::hexDecode against
+    Util::stringToInt, which they replaced: short hex operands, and the
+    60 digits of an object code text record decoded byte by byte the
+    way the loader used to do it.
+
+        g++ -std=c++17 -O2 -I. tests/bench_codec.cpp -o bench_codec
+
+    stringToInt below is the removed routine, with the character tests
+    of Util it called written out.
+*/
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include "codec.h"
+
+using std::string;
+
+static bool stringToInt(const string& src, int& dst, int base){
+    if(src.empty())
+        return false;
+
+    int sum = 0;
+    for(unsigned i = 0; i < src.length(); i++){
+        char c = src[i];
+        if(c >= 'a' && c <= 'z')
+            c -= 32;
+
+        bool digit = c >= '0' && c <= '9';
+        if(digit || (c >= 'A' && c <= 'Z')){
+            if(base <= 10 && !digit)
+                return false;
+            if(base == 16 && !digit && c > 'F')
+                return false;
+
+            int value = digit ? (int)(c - '0') : (int)(c - 'A' + 10);
+            sum += value * (int)pow(base, src.length()-1 - i);
+        }
+        else return false;
+    }
+    dst = sum;
+    return true;
+}
+
+static double since(std::chrono::steady_clock::time_point start){
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(){
+    const char* operands[] = {"1000", "7FFF", "4096", "102A", "30", "FF"};
+    const string record = "1410334820390010362810303010154820613C100300102A0C103900102D";
+    const int parses = 3000000, records = 300000;
+    volatile long sum = 0;
+    int value = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < parses; i++){
+        stringToInt(operands[i % 6], value, 16);
+        sum += value;
+    }
+    double oldParse = since(start);
+
+    start = std::chrono::steady_clock::now();
+    for(int i = 0; i < parses; i++){
+        Codec::parseInt(operands[i % 6], strlen(operands[i % 6]), value, 16);
+        sum += value;
+    }
+    double newParse = since(start);
+
+    start = std::chrono::steady_clock::now();
+    for(int i = 0; i < records; i++)
+        for(size_t k = 0; k < record.length(); k += 2){
+            stringToInt(record.substr(k, 2), value, 16);
+            sum += value;
+        }
+    double oldDecode = since(start);
+
+    unsigned char bytes[30];
+    start = std::chrono::steady_clock::now();
+    for(int i = 0; i < records; i++){
+        Codec::hexDecode(record, bytes);
+        sum += bytes[i % 30];
+    }
+    double newDecode = since(start);
+
+    printf("%d hex operands: stringToInt %.1f ms, parseInt %.1f ms\n", parses, oldParse, newParse);
+    printf("%d text records: stringToInt %.1f ms, hexDecode %.1f ms\n", records, oldDecode, newDecode);
+    return 0;
+}
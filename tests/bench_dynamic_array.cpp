@@ -0,0 +1,89 @@
+/*
+    Benchmark of DynamicArray against the container it replaced, on the
+    arrays the assembler builds most: the few tokens of a source line.
+
+        g++ -std=c++17 -O2 -I. tests/bench_dynamic_array.cpp -o bench_dynamic_array
+
+    OldArray is the part of the former DynamicArray that the benchmark
+    uses: a heap array of 16 default constructed elements, copied when
+    it grows.
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include "dynamic_array.h"
+
+using std::string;
+
+template <typename T>
+class OldArray{
+
+    private:
+        unsigned numberOfElements;
+        unsigned capacity;
+        T* container;
+
+        void resize(unsigned newSize){
+            T* old = container;
+            container = new T[newSize];
+            capacity = newSize;
+            for(unsigned i = 0; i < numberOfElements; i++)
+                container[i] = old[i];
+            delete[] old;
+        }
+
+    public:
+        OldArray() : numberOfElements(0), capacity(16){
+            container = new T[capacity];
+        }
+
+        ~OldArray(){
+            delete[] container;
+        }
+
+        void push_front(const T& entry){
+            for(int i = numberOfElements-1; i >= 0; i--)
+                container[i+1] = container[i];
+            container[0] = entry;
+            numberOfElements++;
+            if(numberOfElements == capacity)
+                resize(capacity * 2);
+        }
+
+        void push_back(const T& entry){
+            container[numberOfElements++] = entry;
+            if(numberOfElements == capacity)
+                resize(capacity * 2);
+        }
+
+        unsigned size() const{
+            return numberOfElements;
+        }
+};
+
+//Builds the tokens of a line with a label, count times. Milliseconds.
+template <typename Array>
+double lines(int count, size_t& tokens){
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < count; i++){
+        Array line;
+        line.push_back(string("LABEL"));
+        line.push_back(string("OPCODE"));
+        line.push_back(string("OPERAND"));
+        line.push_back(string("COMMENT"));
+        line.push_front(string(""));
+        tokens += line.size();
+    }
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(){
+    const int count = 300000;
+    size_t tokens = 0;
+    double before = lines<OldArray<string> >(count, tokens);
+    double after = lines<DynamicArray<string> >(count, tokens);
+    printf("%d lines of 5 tokens: old %.1f ms, DynamicArray %.1f ms (%zu tokens)\n",
+        count, before, after, tokens);
+    return 0;
+}
@@ -0,0 +1,40 @@
+#!/bin/sh
+# Runs the example COPY program with its input on device F1 given in each
+# way the assembler offers, and checks that device 05 gets the example
+# output every time.
+#     sh tests/devices.sh [sicasm]
+# The buffer backend takes one line, so that case is compared with the
+# device file holding the same line.
+
+sicasm=$(cd "$(dirname "${1:-./sicasm}")" && pwd)/$(basename "${1:-./sicasm}")
+root=$(cd "$(dirname "$0")/.." && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+failed=0
+
+# run <name> <expected dev05> <commands>
+run(){
+    rm -f "$work/dev05"
+    (cd "$work" && "$sicasm" -c "load $root/ExampleOutput/object.txt; $3; execute" > output.txt)
+    if cmp -s "$work/dev05" "$2"; then
+        echo "ok      $1"
+    else
+        echo "FAILED  $1"
+        failed=1
+    fi
+}
+
+cp "$root/ExampleInput/devf1" "$work/devf1"
+run "device file" "$root/ExampleOutput/dev05" "status"
+cp "$root/ExampleInput/devf1" "$work/input"
+rm "$work/devf1"
+run "file backend" "$root/ExampleOutput/dev05" "device f1 file input"
+
+line=$(head -n 1 "$root/ExampleInput/devf1")
+printf '%s\n' "$line" > "$work/devf1"
+(cd "$work" && "$sicasm" -c "load $root/ExampleOutput/object.txt; execute" > output.txt)
+mv "$work/dev05" "$work/expected"
+rm "$work/devf1"
+run "one line, buffer backend" "$work/expected" "device f1 buffer $line"
+
+exit $failed
@@ -0,0 +1,39 @@
+#!/bin/sh
+# Runs the example COPY program over a few inputs with sweep, in lockstep
+# and with --scalar, and checks that each output is what execute writes
+# to device 05 for the same input in devf1.
+#     sh tests/sweep.sh [sicasm]
+
+sicasm=$(cd "$(dirname "${1:-./sicasm}")" && pwd)/$(basename "${1:-./sicasm}")
+root=$(cd "$(dirname "$0")/.." && pwd)
+object=$root/ExampleOutput/object.txt
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+failed=0
+
+mkdir "$work/in" "$work/lockstep" "$work/scalar"
+cp "$root/ExampleInput/devf1" "$work/in/example"
+head -n 1 "$root/ExampleInput/devf1" > "$work/in/one"
+printf 'x\n\nyy\n' > "$work/in/blank"
+printf 'no end of line' > "$work/in/unended"
+: > "$work/in/empty"
+
+(cd "$work" && "$sicasm" -c "sweep $object in lockstep; sweep $object in scalar --scalar" > output.txt)
+
+for input in "$work"/in/*; do
+    name=$(basename "$input")
+    cp "$input" "$work/devf1"
+    rm -f "$work/dev05"
+    (cd "$work" && "$sicasm" -c "load $object; execute" > output.txt)
+    touch "$work/dev05"
+    for mode in lockstep scalar; do
+        if cmp -s "$work/dev05" "$work/$mode/$name"; then
+            echo "ok      $name, $mode"
+        else
+            echo "FAILED  $name, $mode"
+            failed=1
+        fi
+    done
+done
+
+exit $failed
@@ -1,7 +1,7 @@
 /*
     This class holds generic/utilitarian functions that
     can be used whenever needed such as parsing a line with
-    the specified delimeters, or converting a string to an integer.
+    the specified delimeters. Number conversions are in codec.h.
 */
 
 #ifndef UTIL_H
@@ -9,7 +9,7 @@
 
 #include "dynamic_array.h"
 #include <string>
-#include <cmath>
+#include <utility>
 using std::string;
 
 class Util{
@@ -39,9 +39,9 @@ class Util{
                     if(!token.empty())
                         if((i < end && !delimFound && nextDelimFound) || i == end){
                             //add it to destination array
-                            dst.push_back(token);
+                            dst.push_back(std::move(token));
                             //reset token for next token extraction
-                            token = "";
+                            token.clear();
                         }
                 }
             }
@@ -97,45 +97,6 @@ class Util{
             return isAlpha(c) || isDigit(c);
         }
 
-        //Takes string and converts it to an integer depending on the specified base
-        static bool stringToInt(const string& src, int& dst, int base){
-            //nothing to process is an error
-            if(src.empty())
-                return false;
-
-            int sum = 0;
-            for(unsigned i = 0; i < src.length(); i++){
-                char c = src[i];
-
-                //convert letters to upper case
-                if(isLowerCase(c))
-                    c -= 32;
-
-                if(isAlphaNumeric(c)){
-
-                    //invalid letter digits for bases smaller than 10
-                    if(base <= 10 && !isDigit(c))
-                        return false;
-
-                    //an invalid hex digit
-                    if(base == 16 && !isHexDigit(c))
-                        return false;
-
-                    int digit = 0;
-                    if(isDigit(c))
-                        digit = (int)(c - '0');
-                    //must be a letter
-                    else
-                        digit = (int)(c - 'A' + 10);
-
-                    sum += digit * (int)pow(base, src.length()-1 - i);
-                }
-                else return false;
-            }
-            dst = sum;
-            return true;
-        }
-
         static bool hasHexFormat(const string& hex){
             for(unsigned i = 0; i < hex.length(); i++){
                 char c = hex[i];
@@ -0,0 +1,377 @@
+
+/*
+    Watch mode for the assembler: "assemble file --watch".
+
+    The source is assembled, then watched with inotify. When it is saved
+    again, the lines are compared with the previous version. A changed
+    line that keeps its label and size is reassembled on its own
+    (Assembler::reassembleLine): its object code is written over the old
+    one in object.txt, and the listing, intermediate and debug files are
+    written from memory. Anything else (added or removed lines, a new label or
+    size, errors, START/END) runs both passes again.
+
+    The directory is watched rather than the file, since many editors
+    save by writing a new file and renaming it over the old one.
+*/
+
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <memory>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include "assembler.h"
+#include "stats.h"
+#include "cache.h"
+#include "dynamic_array.h"
+#include "util.h"
+
+class Watcher{
+
+    private:
+        //a text record of object.txt
+        struct Record{
+            int address;
+            int length;         //bytes
+            size_t offset;      //of its first hex digit in the file
+        };
+
+        string path;
+
+        //the state of the last assembly. assembler is NULL if it failed
+        std::unique_ptr<Assembler> assembler;
+        string source;
+        DynamicArray<size_t> lineStart;     //offset of each source line
+        DynamicArray<int> blockOf;          //per source line, -1 if it has no block
+        DynamicArray<Assembler::Block> blocks;
+        DynamicArray<string> listing;       //one line per block
+        string listingTail;                 //what pass 2 wrote after the blocks
+        DynamicArray<Record> records;
+
+        std::atomic<bool> stopped;
+
+        static bool readLines(const string& path, DynamicArray<string>& lines){
+            ifstream file(path);
+            if(!file.is_open())
+                return false;
+            string line;
+            while(getline(file, line))
+                lines.push_back(line);
+            return true;
+        }
+
+        //the lines of text, as getline reads them
+        static void indexLines(const string& text, size_t from, DynamicArray<size_t>& starts){
+            for(size_t at = from; at < text.length(); ){
+                starts.push_back(at);
+                size_t end = text.find('\n', at);
+                at = end == string::npos ? text.length() : end + 1;
+            }
+        }
+
+        string sourceLine(unsigned i) const{
+            size_t end = i + 1 < lineStart.size() ? lineStart.at(i + 1) - 1 : source.length();
+            if(end > lineStart.at(i) && end == source.length() && source[end - 1] == '\n')
+                end--;
+            return source.substr(lineStart.at(i), end - lineStart.at(i));
+        }
+
+        //Reads back what the passes wrote and matches the source lines
+        //to the blocks of the intermediate file (pass 1 writes a block for
+        //every statement up to END, with the line in upper case)
+        bool loadOutput(){
+            blocks.clear();
+            listing.clear();
+            listingTail.clear();
+            records.clear();
+            blockOf.clear();
+
+            ifstream intermediate("intermediate.txt");
+            Assembler::Block block;
+            while(getline(intermediate, block.source)){
+                getline(intermediate, block.opcode);
+                getline(intermediate, block.address);
+                getline(intermediate, block.operand);
+                getline(intermediate, block.errors);
+                blocks.push_back(block);
+            }
+
+            unsigned next = 0;
+            for(unsigned i = 0; i < lineStart.size(); i++){
+                string line = sourceLine(i);
+                Util::toUpperCase(line);
+                if(next < blocks.size() && line == blocks.at(next).source)
+                    blockOf.push_back(next++);
+                else
+                    blockOf.push_back(-1);
+            }
+            if(next != blocks.size())
+                return false;
+
+            DynamicArray<string> lines;
+            readLines("listing.txt", lines);
+            for(unsigned i = 0; i < lines.size(); i++){
+                if(i < blocks.size())
+                    listing.push_back(lines.at(i));
+                else
+                    listingTail += lines.at(i) + "\n";
+            }
+
+            //text records: T, address (6), length (2), code
+            ifstream object("object.txt");
+            string line;
+            size_t offset = 0;
+            while(getline(object, line)){
+                Record record;
+                if(line.length() > 9 && line[0] == 'T'
+                        && Codec::parseInt(line.substr(1, 6), record.address, 16)
+                        && Codec::parseInt(line.substr(7, 2), record.length, 16)){
+                    record.offset = offset + 9;
+                    records.push_back(record);
+                }
+                offset += line.length() + 1;
+            }
+            return listing.size() == blocks.size();
+        }
+
+        //Runs both passes
+        void assembleAll(){
+            assembler.reset(new Assembler());
+            assembler->pass1(path);
+            assembler->pass2();
+            if(assembler->hasErrors()){
+                cout << "Errors, see listing.txt\n";
+                assembler.reset();
+                return;
+            }
+            if(!loadOutput())
+                assembler.reset();
+        }
+
+        //Writes code over the object code at address in object.txt
+        bool patchObject(int address, const string& code){
+            if(code.empty())
+                return true;
+            unsigned low = 0, high = records.size();
+            while(low < high){
+                unsigned middle = (low + high) / 2;
+                if(records.at(middle).address <= address)
+                    low = middle + 1;
+                else
+                    high = middle;
+            }
+            if(low == 0)
+                return false;
+            const Record& record = records.at(low - 1);
+            if(address + (int)code.length() / 2 > record.address + record.length)
+                return false;
+
+            int file = open("object.txt", O_WRONLY);
+            if(file < 0)
+                return false;
+            off_t at = record.offset + 2 * (address - record.address);
+            bool written = pwrite(file, code.data(), code.length(), at) == (ssize_t)code.length();
+            close(file);
+            return written;
+        }
+
+        void writeListing(){
+            string text;
+            for(unsigned i = 0; i < listing.size(); i++){
+                text += listing.at(i);
+                text += '\n';
+            }
+            text += listingTail;
+            ofstream("listing.txt", std::ios::binary) << text;
+        }
+
+        void writeIntermediate(){
+            string text;
+            for(unsigned i = 0; i < blocks.size(); i++){
+                const Assembler::Block& b = blocks.at(i);
+                const string* fields[] = {&b.source, &b.opcode, &b.address, &b.operand, &b.errors};
+                for(const string* field : fields){
+                    text += *field;
+                    text += '\n';
+                }
+            }
+            ofstream("intermediate.txt", std::ios::binary) << text;
+        }
+
+        //Reassembles the lines of changed that differ from the source on
+        //their own if possible. Only the part between the common beginning
+        //and end of the two texts is split into lines. Returns the number
+        //of lines reassembled, -1 if it was not possible.
+        int reassembleLines(string& changed){
+            if(assembler == NULL)
+                return -1;
+            size_t oldLength = source.length(), newLength = changed.length();
+            size_t shorter = std::min(oldLength, newLength);
+            size_t prefix = std::mismatch(source.begin(), source.begin() + shorter, changed.begin()).first - source.begin();
+            if(prefix == oldLength && prefix == newLength)
+                return 0;
+            size_t suffix = 0;
+            while(suffix < shorter - prefix && source[oldLength - 1 - suffix] == changed[newLength - 1 - suffix])
+                suffix++;
+
+            //the old lines that hold the difference, and where they end
+            if(lineStart.empty())
+                return -1;
+            unsigned first = std::upper_bound(&lineStart.at(0), &lineStart.at(0) + lineStart.size(), prefix) - &lineStart.at(0) - 1;
+            size_t lastByte = std::max(prefix, oldLength - suffix == 0 ? 0 : oldLength - suffix - 1);
+            unsigned last = std::upper_bound(&lineStart.at(0), &lineStart.at(0) + lineStart.size(), lastByte) - &lineStart.at(0) - 1;
+            size_t start = lineStart.at(first);
+            size_t oldTail = last + 1 < lineStart.size() ? lineStart.at(last + 1) : oldLength;
+            size_t newTail = oldTail + newLength - oldLength;
+            if(newTail < start || (newTail < newLength && changed[newTail - 1] != '\n'))
+                return -1;
+
+            //the same number of lines on both sides
+            string region = changed.substr(start, newTail - start);
+            DynamicArray<size_t> starts;
+            indexLines(region, 0, starts);
+            if(starts.size() != last - first + 1)
+                return -1;
+
+            //check every changed line before anything is written
+            DynamicArray<unsigned> lines;
+            DynamicArray<Assembler::Block> updated;
+            DynamicArray<string> codes;
+            DynamicArray<string> listed;
+            for(unsigned k = 0; k < starts.size(); k++){
+                size_t end = k + 1 < starts.size() ? starts.at(k + 1) - 1 : region.length();
+                if(end > starts.at(k) && k + 1 == starts.size() && region[end - 1] == '\n')
+                    end--;
+                string line = region.substr(starts.at(k), end - starts.at(k));
+                unsigned i = first + k;
+                if(line == sourceLine(i))
+                    continue;
+                if(blockOf.at(i) < 0){
+                    //a comment or blank line may only stay one
+                    bool statement = false;
+                    for(unsigned c = 0; c < line.length() && !statement; c++)
+                        statement = line[c] != ' ' && line[c] != '\t';
+                    if(statement && line[0] != '.')
+                        return -1;
+                    continue;
+                }
+                Assembler::Block block = blocks.at(blockOf.at(i));
+                string code, listingLine;
+                if(!assembler->reassembleLine(line, block, code, listingLine))
+                    return -1;
+                lines.push_back(i);
+                updated.push_back(block);
+                codes.push_back(code);
+                listed.push_back(listingLine);
+            }
+
+            for(unsigned n = 0; n < lines.size(); n++){
+                int address = 0;
+                Codec::parseInt(updated.at(n).address, address, 16);
+                if(!patchObject(address, codes.at(n)))
+                    return -1;
+            }
+            for(unsigned n = 0; n < lines.size(); n++){
+                int b = blockOf.at(lines.at(n));
+                blocks.at(b) = updated.at(n);
+                listing.at(b) = listed.at(n);
+            }
+            if(!lines.empty()){
+                writeListing();
+                writeIntermediate();
+                assembler->writeDebugInfo();
+            }
+
+            //the lines after the region moved by the change in length
+            for(unsigned k = 0; k < starts.size(); k++)
+                lineStart.at(first + k) = start + starts.at(k);
+            for(unsigned i = last + 1; i < lineStart.size(); i++)
+                lineStart.at(i) += newLength - oldLength;
+            source.swap(changed);
+            return lines.size();
+        }
+
+        void update(){
+            Timer timer;
+            string changed;
+            if(!AssemblyCache::readFile(path, changed))
+                return;
+
+            int lines = reassembleLines(changed);
+            if(lines >= 0)
+                cout << "Reassembled " << lines << " line(s)";
+            else{
+                source.swap(changed);
+                lineStart.clear();
+                indexLines(source, 0, lineStart);
+                assembleAll();
+                cout << "Assembled " << path;
+            }
+            cout << " in " << std::fixed << std::setprecision(2) << timer.seconds() * 1000 << " ms\n";
+            cout.unsetf(std::ios::floatfield);
+        }
+
+    public:
+        Watcher(const string& path) : path(path), stopped(false){}
+
+        //Assembles the source and again after every save, until stop.
+        //False if the source cannot be watched.
+        bool run(){
+            if(!AssemblyCache::readFile(path, source)){
+                cout << "Failed to load specified file\n";
+                return false;
+            }
+            indexLines(source, 0, lineStart);
+
+            size_t slash = path.rfind('/');
+            string directory = slash == string::npos ? "." : path.substr(0, slash + 1);
+            string name = slash == string::npos ? path : path.substr(slash + 1);
+
+            int notify = inotify_init1(IN_CLOEXEC);
+            if(notify < 0 || inotify_add_watch(notify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0){
+                cout << "Cannot watch " << path << "\n";
+                if(notify >= 0)
+                    close(notify);
+                return false;
+            }
+
+            Timer timer;
+            assembleAll();
+            cout << "Assembled " << path << " in " << std::fixed << std::setprecision(2);
+            cout << timer.seconds() * 1000 << " ms. Watching for changes (Ctrl-C stops).\n";
+            cout.unsetf(std::ios::floatfield);
+
+            char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+            struct pollfd ready = {notify, POLLIN, 0};
+            while(!stopped.load()){
+                //wake up now and then to see if we were stopped
+                if(poll(&ready, 1, 200) <= 0)
+                    continue;
+                ssize_t length = read(notify, events, sizeof events);
+                bool saved = false;
+                for(char* e = events; length > 0 && e < events + length; ){
+                    const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(e);
+                    if(event->len > 0 && name == event->name)
+                        saved = true;
+                    e += sizeof(struct inotify_event) + event->len;
+                }
+                if(saved)
+                    update();
+            }
+            close(notify);
+            return true;
+        }
+
+        //Ends run. Safe to call from a signal handler.
+        void stop(){
+            stopped.store(true);
+        }
+};
+
+#endif